@@ -0,0 +1,303 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+#include "bmp.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+#pragma region work_stealing_pool
+/// @brief Thread pool where every worker has its own task deque
+/// a worker takes its newest task first and, when it runs dry, steals the oldest task of another worker, so
+/// uneven tasks such as files of very different sizes even out without a shared queue everyone contends on.
+/// nested parallel_for calls run inline on the workers
+class work_stealing_pool
+{
+private:
+    struct worker_queue
+    {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+    std::vector<std::unique_ptr<worker_queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_next{0};
+    std::atomic<size_t> m_queued{0}, m_unfinished{0};
+    std::atomic<bool> m_stop{false};
+    std::mutex m_sleep_lock;
+    std::condition_variable m_work, m_idle;
+
+    static size_t &worker_index()
+    {
+        thread_local size_t _index = SIZE_MAX;
+        return _index;
+    }
+
+    bool try_take(size_t _self, std::function<void()> &_task)
+    {
+        {
+            worker_queue &_own = *m_queues[_self];
+            std::lock_guard<std::mutex> _lock(_own.lock);
+            if (!_own.tasks.empty())
+            {
+                _task = std::move(_own.tasks.back());
+                _own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t _i = 1; _i < m_queues.size(); _i++)
+        {
+            worker_queue &_victim = *m_queues[(_self + _i) % m_queues.size()];
+            std::lock_guard<std::mutex> _lock(_victim.lock);
+            if (!_victim.tasks.empty())
+            {
+                _task = std::move(_victim.tasks.front());
+                _victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker_loop(size_t _self)
+    {
+        worker_index() = _self;
+        parallel_for_inline() = true;
+        std::function<void()> _task;
+        while (true)
+        {
+            if (try_take(_self, _task))
+            {
+                m_queued--;
+                try
+                {
+                    _task();
+                }
+                catch (const std::exception &_e)
+                {
+                    // tasks are meant to handle their own errors, this only keeps the worker alive
+                    std::cerr << "Pool task failed: " << _e.what() << std::endl;
+                }
+                catch (...)
+                {
+                    std::cerr << "Pool task failed" << std::endl;
+                }
+                _task = nullptr;
+                if (--m_unfinished == 0)
+                {
+                    std::lock_guard<std::mutex> _lock(m_sleep_lock);
+                    m_idle.notify_all();
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> _lock(m_sleep_lock);
+            m_work.wait(_lock, [&]
+                        { return m_stop || m_queued > 0; });
+            if (m_stop && m_queued == 0)
+                return;
+        }
+    }
+
+public:
+    /// @param threads 0 for one per hardware thread
+    explicit work_stealing_pool(size_t threads = 0)
+    {
+        threads = threads ? threads : std::max<size_t>(1, std::thread::hardware_concurrency());
+        for (size_t _i = 0; _i < threads; _i++)
+            m_queues.push_back(std::make_unique<worker_queue>());
+        for (size_t _i = 0; _i < threads; _i++)
+            m_threads.emplace_back([this, _i]
+                                   { worker_loop(_i); });
+    }
+
+    ~work_stealing_pool()
+    {
+        {
+            std::lock_guard<std::mutex> _lock(m_sleep_lock);
+            m_stop = true;
+        }
+        m_work.notify_all();
+        for (auto &_thread : m_threads)
+            _thread.join();
+    }
+
+    /// @brief queues a task, on the calling worker's own deque when called from a task
+    void submit(std::function<void()> _task)
+    {
+        size_t _self = worker_index();
+        size_t _target = _self < m_queues.size() ? _self : m_next++ % m_queues.size();
+        m_unfinished++;
+        {
+            // counted before it is visible, so a worker taking it never sees the count below zero
+            std::lock_guard<std::mutex> _lock(m_sleep_lock);
+            m_queued++;
+        }
+        {
+            std::lock_guard<std::mutex> _lock(m_queues[_target]->lock);
+            m_queues[_target]->tasks.push_back(std::move(_task));
+        }
+        m_work.notify_one();
+    }
+
+    /// @brief blocks until every submitted task has finished
+    void wait()
+    {
+        std::unique_lock<std::mutex> _lock(m_sleep_lock);
+        m_idle.wait(_lock, [&]
+                    { return m_unfinished == 0; });
+    }
+
+    size_t threads() const { return m_threads.size(); }
+};
+
+/// @brief Bytes shared by concurrent tasks, a task waits until its estimate fits
+/// a task larger than the whole budget still runs, alone
+class memory_budget
+{
+private:
+    size_t m_limit, m_used{};
+    std::mutex m_lock;
+    std::condition_variable m_freed;
+
+public:
+    explicit memory_budget(size_t limit) : m_limit(limit) {}
+
+    void acquire(size_t _bytes)
+    {
+        std::unique_lock<std::mutex> _lock(m_lock);
+        m_freed.wait(_lock, [&]
+                     { return m_used == 0 || m_used + _bytes <= m_limit; });
+        m_used += _bytes;
+    }
+
+    void release(size_t _bytes)
+    {
+        {
+            std::lock_guard<std::mutex> _lock(m_lock);
+            m_used -= _bytes;
+        }
+        m_freed.notify_all();
+    }
+
+    size_t limit() const { return m_limit; }
+};
+
+/// @brief Bytes of a memory_budget held from construction to destruction, so they come back on any exit
+class budget_reservation
+{
+private:
+    memory_budget &m_budget;
+    size_t m_bytes;
+
+public:
+    budget_reservation(memory_budget &budget, size_t bytes) : m_budget(budget), m_bytes(bytes) { m_budget.acquire(m_bytes); }
+
+    budget_reservation(const budget_reservation &) = delete;
+    budget_reservation &operator=(const budget_reservation &) = delete;
+
+    ~budget_reservation() { m_budget.release(m_bytes); }
+};
+#pragma endregion
+
+#pragma region batch
+struct batch_options
+{
+    size_t threads = 0;                        // 0 for one per hardware thread
+    size_t memory_limit = size_t(1) << 30;     // bytes of decoded images in flight
+    size_t working_copies = 2;                 // images an operation holds at once, e.g. source and scratch
+    size_t file_memory_limit = SIZE_MAX;       // tracked bytes one file may hold at once, a file going over fails
+    bool recursive = false;
+};
+
+struct batch_result
+{
+    std::string input;
+    std::string output;
+    bmp_status status; // unsupported_format for files `Format` can't hold
+    bool written;
+    memory_stats memory; // tracked memory of decoding, processing and writing the file
+    std::string error;   // what an operation or the filesystem threw, empty when nothing did
+};
+
+/// @brief Memory a file will take once decoded, from its headers alone
+size_t estimate_decoded_bytes(const bmp_info &_info, size_t _bytes_per_pixel, size_t _working_copies)
+{
+    size_t _stride = (_info.width * _bytes_per_pixel + 15) / 16 * 16;
+    return _stride * _info.height * std::max<size_t>(_working_copies, 1);
+}
+
+/// @brief Runs `_operations` in order over every bitmap of `_input_dir` and writes the results under the same
+/// names into `_output_dir`, one task per file on a work stealing pool
+/// headers are probed first so every task knows its memory cost before it decodes anything; tasks wait for
+/// room in the budget, so large files run fewer at a time than small ones. Every file runs in its own
+/// memory_scope, its measured use ends up in the result. An exception fails its file alone
+template <class Format>
+std::vector<batch_result> batch_process(const std::string &_input_dir, const std::string &_output_dir, const std::vector<std::function<void(image<Format> &)>> &_operations, const batch_options &_options = {})
+{
+    std::vector<bmp_probe_result> _probes = probe_directory(_input_dir, _options.recursive);
+    std::vector<batch_result> _results(_probes.size());
+
+    std::error_code _ec;
+    std::filesystem::create_directories(_output_dir, _ec);
+    if (_ec)
+    {
+        std::cerr << "Can't create " << _output_dir << ": " << _ec.message() << std::endl;
+        return {};
+    }
+
+    memory_budget _budget(_options.memory_limit);
+    {
+        work_stealing_pool _pool(_options.threads);
+        for (size_t _i = 0; _i < _probes.size(); _i++)
+        {
+            const bmp_probe_result &_probe = _probes[_i];
+            batch_result &_result = _results[_i];
+            std::filesystem::path _relative = std::filesystem::relative(_probe.file_name, _input_dir, _ec);
+            _result = {_probe.file_name, (std::filesystem::path(_output_dir) / (_ec ? std::filesystem::path(_probe.file_name).filename() : _relative)).string(), _probe.status, false, {}, {}};
+            if (_probe.status != bmp_status::ok)
+                continue;
+
+            _pool.submit([&_result, &_probe, &_operations, &_budget, &_options]
+                         {
+                budget_reservation _reservation(_budget, estimate_decoded_bytes(_probe.info, sizeof(typename Format::pixel), _options.working_copies));
+                memory_scope _scope(_result.input, _options.file_memory_limit);
+                try
+                {
+                    image<Format> _img;
+                    _result.status = read_bmp(_result.input, _img);
+                    if (_result.status == bmp_status::ok)
+                    {
+                        for (const auto &_operation : _operations)
+                            _operation(_img);
+                        std::error_code _dir_ec;
+                        std::filesystem::create_directories(std::filesystem::path(_result.output).parent_path(), _dir_ec);
+                        _result.written = write_bmp(_result.output, _img.view());
+                    }
+                }
+                catch (const std::bad_alloc &)
+                {
+                    // over the file's limit, or out of memory
+                    _result.written = false;
+                }
+                catch (const std::exception &_e)
+                {
+                    _result.written = false;
+                    _result.error = _e.what();
+                }
+                catch (...)
+                {
+                    _result.written = false;
+                    _result.error = "unknown exception";
+                }
+                _result.memory = _scope.stats(); });
+        }
+        _pool.wait();
+    }
+    return _results;
+}
+#pragma endregion
+
+#endif
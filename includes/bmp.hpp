@@ -2,6 +2,10 @@
 #define BMP_HPP
 
 #include "utilities.hpp"
+#include "image.hpp"
+#include "cow_image.hpp"
+#include <cctype>
+#include <variant>
 
 #pragma region file_headers
 // Swap between little and small endian
@@ -23,7 +27,7 @@ typedef struct tagBITMAPFILEHEADER
     WORD bfReserved2;
     DWORD bfOffBits;
 } BITMAPFILEHEADER, *LPBITMAPFILEHEADER, *PBITMAPFILEHEADER;
-#pragma pop(0) // enable padding
+#pragma pack(pop) // enable padding
 
 #pragma pack(push, 1) // Disable padding
 // https://learn.microsoft.com/en-us/windows/win32/api/wingdi/ns-wingdi-bitmapinfoheader
@@ -41,22 +45,186 @@ typedef struct tagBITMAPINFOHEADER
     DWORD biClrUsed;
     DWORD biClrImportant;
 } BITMAPINFOHEADER, *LPBITMAPINFOHEADER, *PBITMAPINFOHEADER;
-#pragma pop(0) // enable padding
+#pragma pack(pop) // enable padding
 
-#pragma pack(push, 1) // Disable padding
-typedef struct tagRGBQUAD
+
+#pragma end_region
+
+#pragma region probe
+enum class bmp_status
 {
-    BYTE rgbBlue;
-    BYTE rgbGreen;
-    BYTE rgbRed;
-    BYTE rgbReserved;
-} RGBQUAD;
-#pragma pop(0) // enable padding
+    ok,
+    cant_open,
+    truncated,          // file ends inside the headers or the pixel data
+    not_a_bitmap,       // no BM signature
+    unsupported_header, // info header older than BITMAPINFOHEADER
+    bad_dimensions,
+    bad_bit_count,
+    bad_offset,        // pixel data offset points inside the headers
+    unsupported_format // valid bitmap the requested pixel format can't hold
+};
 
+const char *to_string(bmp_status _status)
+{
+    switch (_status)
+    {
+    case bmp_status::ok:
+        return "ok";
+    case bmp_status::cant_open:
+        return "can't open file";
+    case bmp_status::truncated:
+        return "truncated file";
+    case bmp_status::not_a_bitmap:
+        return "not a bitmap file";
+    case bmp_status::unsupported_header:
+        return "unsupported info header";
+    case bmp_status::bad_dimensions:
+        return "bad dimensions";
+    case bmp_status::bad_bit_count:
+        return "bad bit count";
+    case bmp_status::bad_offset:
+        return "bad pixel data offset";
+    case bmp_status::unsupported_format:
+        return "unsupported pixel format";
+    }
+    return "unknown";
+}
 
-#pragma end_region
+/// @brief What the two headers of a bmp say about it, validated against each other and the file size
+struct bmp_info
+{
+    size_t width{};
+    size_t height{};
+    bool top_down{}; // negative biHeight, first stored row is the top one
+    WORD bit_count{};
+    DWORD compression{};
+    DWORD colors_used{};
+    size_t row_stride{}; // bytes per stored row including padding, 0 for compressed data
+    size_t pixel_offset{};
+    size_t file_size{}; // actual size on disk, bfSize is often wrong
+};
+
+/// @brief Checks a pair of headers read from a file of `_file_size` bytes and fills `_info`
+bmp_status validate_bmp_headers(const BITMAPFILEHEADER &_bfh, const BITMAPINFOHEADER &_bih, size_t _file_size, bmp_info &_info)
+{
+    if (_bfh.bfType != 0x4d42 /*BM*/)
+        return bmp_status::not_a_bitmap;
+    if (_bih.biSize < sizeof(BITMAPINFOHEADER))
+        return bmp_status::unsupported_header;
+    if (_bih.biWidth <= 0 || _bih.biHeight == 0 || _bih.biHeight == INT32_MIN || _bih.biPlanes != 1)
+        return bmp_status::bad_dimensions;
+    switch (_bih.biBitCount)
+    {
+    case 1:
+    case 4:
+    case 8:
+    case 16:
+    case 24:
+    case 32:
+        break;
+    default:
+        return bmp_status::bad_bit_count;
+    }
+
+    _info.width = static_cast<size_t>(_bih.biWidth);
+    _info.top_down = _bih.biHeight < 0;
+    _info.height = static_cast<size_t>(_info.top_down ? -int64_t(_bih.biHeight) : int64_t(_bih.biHeight));
+    _info.bit_count = _bih.biBitCount;
+    _info.compression = _bih.biCompression;
+    _info.colors_used = _bih.biClrUsed;
+    _info.pixel_offset = _bfh.bfOffBits;
+    _info.file_size = _file_size;
+
+    if (_info.pixel_offset < sizeof(BITMAPFILEHEADER) + _bih.biSize)
+        return bmp_status::bad_offset;
+    if (_info.pixel_offset > _file_size)
+        return bmp_status::truncated;
+    // BI_RGB and BI_BITFIELDS store plain rows, the rle variants don't have a fixed stride
+    if (_info.compression == 0 || _info.compression == 3)
+    {
+        _info.row_stride = ((_info.width * _info.bit_count + 31) / 32) * 4;
+        if ((_file_size - _info.pixel_offset) / _info.row_stride < _info.height)
+            return bmp_status::truncated;
+    }
+    return bmp_status::ok;
+}
+
+/// @brief Reads and validates both headers from the start of an open file
+bmp_status read_bmp_headers(std::ifstream &_in_file, const std::string &_file_name, BITMAPFILEHEADER &_bfh, BITMAPINFOHEADER &_bih, bmp_info &_info)
+{
+    if (!_in_file.read(reinterpret_cast<char *>(&_bfh), sizeof(BITMAPFILEHEADER)))
+        return bmp_status::truncated;
+    if (_bfh.bfType != 0x4d42 /*BM*/)
+        return bmp_status::not_a_bitmap;
+    if (!_in_file.read(reinterpret_cast<char *>(&_bih), sizeof(BITMAPINFOHEADER)))
+        return bmp_status::truncated;
+
+    std::error_code _ec;
+    size_t _file_size = std::filesystem::file_size(_file_name, _ec);
+    if (_ec)
+        return bmp_status::cant_open;
+    return validate_bmp_headers(_bfh, _bih, _file_size, _info);
+}
+
+/// @brief Reads only the file and info headers of `_file_name`, no state is shared so it can run on any thread
+bmp_status probe_bmp(const std::string &_file_name, bmp_info &_info)
+{
+    std::ifstream _in_file(_file_name, std::ios_base::binary);
+    if (!_in_file.is_open())
+        return bmp_status::cant_open;
+
+    BITMAPFILEHEADER _bfh;
+    BITMAPINFOHEADER _bih;
+    return read_bmp_headers(_in_file, _file_name, _bfh, _bih, _info);
+}
+
+struct bmp_probe_result
+{
+    std::string file_name;
+    bmp_status status;
+    bmp_info info;
+};
+
+/// @brief Probes every .bmp file in a directory, spread over the hardware threads
+/// @param _recursive also descend into sub directories
+std::vector<bmp_probe_result> probe_directory(const std::string &_directory, bool _recursive = false)
+{
+    std::vector<bmp_probe_result> _results;
+    std::error_code _ec;
+    // error_code overloads throughout, an entry that can't be read is skipped and a listing that fails ends the
+    // scan with what was found so far
+    auto _scan = [&](auto _it)
+    {
+        for (; !_ec && _it != decltype(_it)(); _it.increment(_ec))
+        {
+            std::error_code _entry_ec;
+            std::string _ext = _it->path().extension().string();
+            std::transform(_ext.begin(), _ext.end(), _ext.begin(), [](unsigned char _c)
+                           { return std::tolower(_c); });
+            if (_ext == ".bmp" && _it->is_regular_file(_entry_ec))
+                _results.push_back({_it->path().string(), bmp_status::ok, {}});
+        }
+    };
+    const auto _options = std::filesystem::directory_options::skip_permission_denied;
+    if (_recursive)
+        _scan(std::filesystem::recursive_directory_iterator(_directory, _options, _ec));
+    else
+        _scan(std::filesystem::directory_iterator(_directory, _options, _ec));
+    if (_ec)
+        std::cerr << "Can't list " << _directory << ": " << _ec.message() << std::endl;
+
+    parallel_for(_results.size(), [&](size_t _begin, size_t _end)
+                 {
+        for (size_t _i = _begin; _i < _end; _i++)
+            _results[_i].status = probe_bmp(_results[_i].file_name, _results[_i].info); }, 64);
+    return _results;
+}
+#pragma endregion
 
 #pragma region bmp
+/// @brief bytes per read or write of pixel data, the background thread works up to two chunks ahead of the caller
+constexpr size_t bmp_io_chunk_size = 1 << 16;
+
 // TODO: Implement support for different bmp versions
 class bmp
 {
@@ -70,6 +238,7 @@ private:
     bool m_is_little_endian;
 #endif
     size_t m_width, m_height;
+    bool m_top_down{}; // rows are stored top to bottom in the file
     std::shared_ptr<std::vector<std::vector<RGBTRIPLE>>> m_pixel_data;
     char padding[4];
 
@@ -83,13 +252,14 @@ public:
             m_is_little_endian = false;
 #endif
     }
-    void read_file()
+    /// @return false if the file is missing, malformed or not a 24 bit uncompressed bitmap
+    bool read_file()
     {
         m_in_file.open(m_file_name, std::ios_base::binary);
         if (!m_in_file.is_open())
         {
             std::cerr << "No such file exists";
-            return;
+            return false;
         }
 
         /*if (is_little_endian)
@@ -99,31 +269,65 @@ public:
             endswap(&bfh.bfReserved2);
             endswap(&bfh.bfOffBits);
         }*/
-        read_file_header();
-        read_info_header();
+        if (!read_file_header() || !read_info_header())
+        {
+            m_in_file.close();
+            return false;
+        }
         (*m_pixel_data).resize(m_height);
         for (auto &i : (*m_pixel_data))
         {
             i.resize(m_width);
         }
         read_pixel_data();
+        m_in_file.close();
+        return true;
     }
-    void read_file_header()
+    bool read_file_header()
     {
         m_in_file.read(reinterpret_cast<char *>(&m_bfh), sizeof(BITMAPFILEHEADER));
-        if (!check_bmp_header())
+        if (!m_in_file || !check_bmp_header())
         {
             std::cerr << "Not a bitmap file!";
-            m_in_file.close();
-            return;
+            return false;
         }
         m_file_size = m_bfh.bfSize;
+        return true;
     }
-    void read_info_header()
+    bool read_info_header()
     {
         m_in_file.read(reinterpret_cast<char *>(&m_bih), sizeof(BITMAPINFOHEADER));
-        m_width = m_bih.biWidth;
-        m_height = m_bih.biHeight;
+        if (!m_in_file)
+        {
+            std::cerr << "Truncated info header!";
+            return false;
+        }
+
+        std::error_code _ec;
+        uintmax_t _file_size = std::filesystem::file_size(m_file_name, _ec);
+        if (_ec)
+        {
+            std::cerr << "Can't get the size of " << m_file_name << ": " << _ec.message();
+            return false;
+        }
+        bmp_info _info;
+        bmp_status _status = validate_bmp_headers(m_bfh, m_bih, _file_size, _info);
+        if (_status != bmp_status::ok)
+        {
+            std::cerr << "Invalid bitmap: " << to_string(_status);
+            return false;
+        }
+        if (_info.bit_count != 24 || _info.compression != 0)
+        {
+            std::cerr << "Only uncompressed 24 bit bitmaps are supported";
+            return false;
+        }
+        m_width = _info.width;
+        m_height = _info.height;
+        m_top_down = _info.top_down;
+        // the pixels don't have to follow the info header directly
+        m_in_file.seekg(_info.pixel_offset);
+        return true;
     }
 
     void read_pixel_data()
@@ -132,22 +336,22 @@ public:
         size_t padding_width = (4 - (m_width * sizeof(RGBTRIPLE)) % 4) % 4;
         std::clog << "Padding width: " << padding_width << " bytes\n";
 
-        // Iterate over each row of the image
-        for (int i = 0; i < m_height; ++i)
+        size_t row_bytes = m_width * sizeof(RGBTRIPLE);
         {
-            for (int j = 0; j < m_width; ++j)
+            // rows are copied out of one chunk while the next is read
+            read_ahead_reader reader(m_in_file, bmp_io_chunk_size, 3, (row_bytes + padding_width) * m_height);
+            // Iterate over each row of the image, row 0 of the pixel data is the top one whatever the file order
+            for (int i = 0; i < m_height; ++i)
             {
-                if (!m_in_file.read(reinterpret_cast<char *>(&m_pixel_data->at(i)[j]), sizeof(RGBTRIPLE)))
+                size_t row = m_top_down ? i : m_height - 1 - i;
+                if (reader.read(reinterpret_cast<char *>(m_pixel_data->at(row).data()), row_bytes) != row_bytes)
                 {
-                    std::cerr << "Error reading pixel data at row " << i << ", column " << j << "\n";
+                    std::cerr << "Error reading pixel data at row " << i << "\n";
                     return;
                 }
-                // else{
-                //     std::clog<<"Readed row "<<i<<" col "<<j<<std::endl;
-                // }
+                // Skip the padding bytes at the end of the row
+                reader.read(padding, padding_width);
             }
-            // Skip the padding bytes at the end of the row
-            m_in_file.ignore(padding_width);
         }
 
         // Check if we reached the end of the file
@@ -175,21 +379,38 @@ public:
         out_file.write(reinterpret_cast<char *>(&m_bfh), sizeof(BITMAPFILEHEADER));
         out_file.write(reinterpret_cast<char *>(&m_bih), sizeof(BITMAPINFOHEADER));
         size_t padding_width = (4 - (m_width * sizeof(RGBTRIPLE)) % 4) % 4;
-        for (int i = 0; i < m_height; i++)
+        const char zeros[4] = {};
         {
-            for (int j = 0; j < m_width; j++)
+            write_behind_writer writer(out_file, std::min(bmp_io_chunk_size, (m_width * sizeof(RGBTRIPLE) + padding_width) * m_height));
+            for (int i = 0; i < m_height; i++)
             {
-                out_file.write(reinterpret_cast<char *>(&((*dat)[i][j])), sizeof(RGBTRIPLE));
+                // the headers are the ones read, so the rows go back in the order of the source file
+                size_t row = m_top_down ? i : m_height - 1 - i;
+                writer.write(reinterpret_cast<char *>((*dat)[row].data()), m_width * sizeof(RGBTRIPLE));
+                writer.write(zeros, padding_width);
             }
-            out_file.write(0x00, padding_width);
         }
         out_file.close();
     }
 
+    /// @brief Writes a one byte per pixel image, e.g. from rgb_to_grayscale, as an 8 bit bitmap with a 256 entry
+    /// grayscale palette instead of the 24 bit rows of this object, a third of the size
+    bool write_to_file(std::string output_file_name, const image_view<pixel_format::gray8> &gray);
+
+    /// @brief the pixels with row 0 at the top whatever the row order of the file
     std::shared_ptr<std::vector<std::vector<RGBTRIPLE>>> get_pixel_data()
     {
         return m_pixel_data;
     }
+    /// @brief copy on write handle of the pixels, unlike get_pixel_data edits through it don't reach this object
+    /// and copies of it share memory until written
+    cow_image<pixel_format::bgr24> snapshot() const
+    {
+        cow_image<pixel_format::bgr24> _img(m_width, m_height);
+        for (size_t _row = 0; _row < m_height; _row++)
+            std::memcpy(_img.writable_row(_row), (*m_pixel_data)[_row].data(), m_width * sizeof(RGBTRIPLE));
+        return _img;
+    }
     size_t getsize() const { return m_file_size; }
     bool check_bmp_header() const
     {
@@ -199,4 +420,461 @@ public:
     }
 };
 #pragma endregion
-#endif
\ No newline at end of file
+
+#pragma region rle
+namespace rle_detail
+{
+    /// @brief pixels from `_x` repeating `_row[_x]`, or with `_pairs` the pair `_row[_x], _row[_x + 1]`, at most 255
+    size_t run_at(const BYTE *_row, size_t _x, size_t _width, bool _pairs)
+    {
+        size_t _n = 1;
+        while (_x + _n < _width && _n < 255 && _row[_x + _n] == _row[_x + (_pairs ? _n % 2 : 0)])
+            _n++;
+        return _n;
+    }
+
+    /// @brief Appends one row in BI_RLE8 or, for `_nibbles`, BI_RLE4 encoding followed by the end of line marker
+    /// runs of 3 or more pixels become encoded runs, a BI_RLE4 run may alternate two indices. Anything between
+    /// runs goes out in absolute mode, or as runs of one and two when too short for it
+    void encode_row(const BYTE *_row, size_t _width, bool _nibbles, tracked_vector<BYTE> &_out)
+    {
+        auto _emit_run = [&](size_t _x, size_t _n)
+        {
+            BYTE _value = _nibbles ? static_cast<BYTE>((_row[_x] << 4) | ((_n > 1 ? _row[_x + 1] : _row[_x]) & 0x0f)) : _row[_x];
+            _out.push_back(static_cast<BYTE>(_n));
+            _out.push_back(_value);
+        };
+
+        size_t _x = 0;
+        while (_x < _width)
+        {
+            size_t _run = run_at(_row, _x, _width, _nibbles);
+            if (_run >= 3)
+            {
+                _emit_run(_x, _run);
+                _x += _run;
+                continue;
+            }
+            // literal stretch up to the next run worth encoding
+            size_t _end = _x;
+            while (_end < _width && _end - _x < 255)
+            {
+                size_t _next = run_at(_row, _end, _width, _nibbles);
+                if (_next >= 3)
+                    break;
+                _end = std::min(_end + _next, _x + 255);
+            }
+            size_t _n = _end - _x;
+            if (_n < 3)
+            {
+                // absolute mode needs at least 3 pixels, 0 1 and 0 2 are end of bitmap and delta
+                for (size_t _i = _x; _i < _end;)
+                {
+                    size_t _piece = std::min(run_at(_row, _i, _end, _nibbles), _end - _i);
+                    _emit_run(_i, _piece);
+                    _i += _piece;
+                }
+                _x = _end;
+                continue;
+            }
+            _out.push_back(0);
+            _out.push_back(static_cast<BYTE>(_n));
+            size_t _bytes = _nibbles ? (_n + 1) / 2 : _n;
+            for (size_t _i = 0; _i < _bytes; _i++)
+            {
+                if (!_nibbles)
+                    _out.push_back(_row[_x + _i]);
+                else
+                {
+                    size_t _p = _x + 2 * _i;
+                    _out.push_back(static_cast<BYTE>((_row[_p] << 4) | (_p + 1 < _end ? _row[_p + 1] & 0x0f : 0)));
+                }
+            }
+            // absolute runs end on a 16 bit boundary
+            if (_bytes % 2)
+                _out.push_back(0);
+            _x = _end;
+        }
+        _out.push_back(0);
+        _out.push_back(0);
+    }
+}; // namespace rle_detail
+
+/// @brief Encodes the indices as BI_RLE8 (`_bit_count` 8) or BI_RLE4 (`_bit_count` 4) pixel data, rows bottom up
+/// each ending with an end of line marker and the whole with the end of bitmap marker
+/// indices must fit in `_bit_count` bits
+void encode_bmp_rle(const image_view<pixel_format::gray8> &_indices, WORD _bit_count, tracked_vector<BYTE> &_out)
+{
+    _out.clear();
+    for (size_t _row = _indices.height(); _row-- > 0;)
+        rle_detail::encode_row(_indices.row(_row), _indices.width(), _bit_count == 4, _out);
+    _out.push_back(0);
+    _out.push_back(1);
+}
+
+/// @brief Decodes BI_RLE8 (`_bit_count` 8) or BI_RLE4 (`_bit_count` 4) pixel data into `_indices`, which the
+/// caller clears first as deltas and early line ends skip pixels. Runs are memset fills, pixels falling outside
+/// the image are dropped and data ending without the end of bitmap marker is taken as complete
+/// @return truncated if the data ends inside a command
+bmp_status decode_bmp_rle(const BYTE *_data, size_t _size, WORD _bit_count, const image_view<pixel_format::gray8> &_indices)
+{
+    const bool _nibbles = _bit_count == 4;
+    const size_t _w = _indices.width(), _h = _indices.height();
+    size_t _x = 0, _y = 0; // _y counts stored rows, the bottom one first
+    size_t _i = 0;
+    while (_i + 1 < _size)
+    {
+        BYTE _count = _data[_i], _value = _data[_i + 1];
+        _i += 2;
+        if (_count != 0)
+        {
+            if (_y < _h && _x < _w)
+            {
+                BYTE *_dst = _indices.row(_h - 1 - _y) + _x;
+                size_t _n = std::min<size_t>(_count, _w - _x);
+                BYTE _high = _nibbles ? _value >> 4 : _value, _low = _nibbles ? _value & 0x0f : _value;
+                if (_high == _low)
+                    std::memset(_dst, _high, _n);
+                else
+                    for (size_t _k = 0; _k < _n; _k++)
+                        _dst[_k] = _k % 2 ? _low : _high;
+            }
+            _x += _count;
+            continue;
+        }
+        switch (_value)
+        {
+        case 0: // end of line
+            _x = 0;
+            _y++;
+            break;
+        case 1: // end of bitmap
+            return bmp_status::ok;
+        case 2: // delta, moves right and up
+            if (_i + 1 >= _size)
+                return bmp_status::truncated;
+            _x += _data[_i];
+            _y += _data[_i + 1];
+            _i += 2;
+            break;
+        default: // absolute run of `_value` pixels, padded to 16 bits
+        {
+            size_t _bytes = _nibbles ? (_value + 1) / 2 : _value;
+            if (_i + _bytes > _size)
+                return bmp_status::truncated;
+            if (_y < _h && _x < _w)
+            {
+                BYTE *_dst = _indices.row(_h - 1 - _y) + _x;
+                size_t _n = std::min<size_t>(_value, _w - _x);
+                if (!_nibbles)
+                    std::memcpy(_dst, _data + _i, _n);
+                else
+                    for (size_t _k = 0; _k < _n; _k++)
+                        _dst[_k] = _k % 2 ? _data[_i + _k / 2] & 0x0f : _data[_i + _k / 2] >> 4;
+            }
+            _x += _value;
+            _i += _bytes + _bytes % 2;
+        }
+        }
+    }
+    return bmp_status::ok;
+}
+#pragma endregion
+
+#pragma region typed_io
+using any_image = std::variant<image_bgr24, image_bgra32, image_gray8>;
+
+/// @brief Reads the colour table that follows the info header
+bool read_bmp_palette(std::ifstream &_in_file, const BITMAPINFOHEADER &_bih, std::vector<RGBQUAD> &_palette)
+{
+    size_t _entries = _bih.biClrUsed ? _bih.biClrUsed : size_t(1) << _bih.biBitCount;
+    _palette.resize(std::min<size_t>(_entries, 256));
+    _in_file.seekg(sizeof(BITMAPFILEHEADER) + _bih.biSize);
+    return static_cast<bool>(_in_file.read(reinterpret_cast<char *>(_palette.data()), _palette.size() * sizeof(RGBQUAD)));
+}
+
+/// @brief true if entry i of the palette is the gray level i, so indices are the gray values themselves
+bool is_identity_gray_palette(const std::vector<RGBQUAD> &_palette)
+{
+    if (_palette.size() != 256)
+        return false;
+    for (size_t _i = 0; _i < _palette.size(); _i++)
+    {
+        if (_palette[_i].rgbBlue != _i || _palette[_i].rgbGreen != _i || _palette[_i].rgbRed != _i)
+            return false;
+    }
+    return true;
+}
+
+/// @brief true when the pixel rows can be copied straight into `Format`
+template <class Format>
+bool bmp_layout_matches(std::ifstream &_in_file, const BITMAPINFOHEADER &_bih, const bmp_info &_info)
+{
+    if (_info.bit_count != Format::bit_count)
+        return false;
+    if constexpr (std::is_same_v<Format, pixel_format::bgra32>)
+    {
+        if (_info.compression == 3 /*BI_BITFIELDS*/)
+        {
+            // the masks follow the 40 byte header whatever the header version
+            DWORD _masks[3];
+            _in_file.seekg(sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER));
+            return _in_file.read(reinterpret_cast<char *>(_masks), sizeof(_masks)) &&
+                   _masks[0] == 0x00ff0000 && _masks[1] == 0x0000ff00 && _masks[2] == 0x000000ff;
+        }
+    }
+    if (_info.compression != 0 /*BI_RGB*/)
+        return false;
+    if constexpr (Format::is_gray)
+    {
+        std::vector<RGBQUAD> _palette;
+        return read_bmp_palette(_in_file, _bih, _palette) && is_identity_gray_palette(_palette);
+    }
+    return true;
+}
+
+/// @brief Reads a bitmap whose bit count matches `Format` straight into `_img`, no conversion pass
+/// the image takes the stride and row order of the file so all rows come in with one read, a bottom up file
+/// becomes a bottom up image whose views still start at the top row
+/// @return unsupported_format if the file needs a conversion to fit `Format`
+template <class Format>
+bmp_status read_bmp(const std::string &_file_name, image<Format> &_img)
+{
+    static_assert(Format::bit_count != 0, "pixel format has no bmp equivalent");
+    std::ifstream _in_file(_file_name, std::ios_base::binary);
+    if (!_in_file.is_open())
+        return bmp_status::cant_open;
+
+    BITMAPFILEHEADER _bfh;
+    BITMAPINFOHEADER _bih;
+    bmp_info _info;
+    bmp_status _status = read_bmp_headers(_in_file, _file_name, _bfh, _bih, _info);
+    if (_status != bmp_status::ok)
+        return _status;
+    if (!bmp_layout_matches<Format>(_in_file, _bih, _info))
+        return bmp_status::unsupported_format;
+
+    // an image recycled from a frame of the same layout is read into without reallocating
+    if (_img.width() != _info.width || _img.height() != _info.height || static_cast<size_t>(std::abs(_img.stride())) != _info.row_stride || _img.bottom_up() == _info.top_down)
+        _img = image<Format>(_info.width, _info.height, _info.row_stride, !_info.top_down);
+    _in_file.seekg(_info.pixel_offset);
+    if (!_in_file.read(reinterpret_cast<char *>(_img.data()), _info.row_stride * _info.height))
+        return bmp_status::truncated;
+    return bmp_status::ok;
+}
+
+/// @brief Reads a 4 or 8 bit bitmap, plain or BI_RLE4 / BI_RLE8 compressed, as indices and its colour table
+bmp_status read_bmp(const std::string &_file_name, palette_image &_img)
+{
+    std::ifstream _in_file(_file_name, std::ios_base::binary);
+    if (!_in_file.is_open())
+        return bmp_status::cant_open;
+
+    BITMAPFILEHEADER _bfh;
+    BITMAPINFOHEADER _bih;
+    bmp_info _info;
+    bmp_status _status = read_bmp_headers(_in_file, _file_name, _bfh, _bih, _info);
+    if (_status != bmp_status::ok)
+        return _status;
+    bool _rle = _info.compression == (_info.bit_count == 8 ? 1 /*BI_RLE8*/ : 2 /*BI_RLE4*/);
+    if ((_info.bit_count != 4 && _info.bit_count != 8) || (_info.compression != 0 && !_rle))
+        return bmp_status::unsupported_format;
+    // compressed bitmaps can only be bottom up
+    if (_rle && _info.top_down)
+        return bmp_status::bad_dimensions;
+    if (!read_bmp_palette(_in_file, _bih, _img.palette))
+        return bmp_status::truncated;
+
+    if (_img.indices.width() != _info.width || _img.indices.height() != _info.height)
+        _img.indices = image_gray8(_info.width, _info.height);
+    else if (_rle)
+        for (size_t _row = 0; _row < _info.height; _row++)
+            std::memset(_img.indices.row(_row), 0, _info.width);
+    _in_file.seekg(_info.pixel_offset);
+
+    if (_rle)
+    {
+        size_t _size = _info.file_size - _info.pixel_offset;
+        if (_bih.biSizeImage != 0)
+            _size = std::min<size_t>(_size, _bih.biSizeImage);
+        tracked_vector<BYTE> _data(_size);
+        if (!_in_file.read(reinterpret_cast<char *>(_data.data()), _size))
+            return bmp_status::truncated;
+        return decode_bmp_rle(_data.data(), _size, _info.bit_count, _img.indices.view());
+    }
+
+    tracked_vector<BYTE> _packed(_info.row_stride);
+    read_ahead_reader _reader(_in_file, bmp_io_chunk_size, 3, _info.row_stride * _info.height);
+    for (size_t _row = 0; _row < _info.height; _row++)
+    {
+        if (_reader.read(reinterpret_cast<char *>(_packed.data()), _packed.size()) != _packed.size())
+            return bmp_status::truncated;
+        BYTE *_dst = _img.indices.row(_info.top_down ? _row : _info.height - 1 - _row);
+        if (_info.bit_count == 8)
+            std::memcpy(_dst, _packed.data(), _info.width);
+        else
+            for (size_t _col = 0; _col < _info.width; _col++)
+                _dst[_col] = _col % 2 ? _packed[_col / 2] & 0x0f : _packed[_col / 2] >> 4;
+    }
+    return bmp_status::ok;
+}
+
+/// @brief Reads 4, 8, 24 and 32 bit bitmaps into the matching format
+/// 4 bit files and 8 bit files with a colour palette, plain or RLE compressed, are expanded to bgr24 as the
+/// palette can't be kept
+bmp_status read_bmp(const std::string &_file_name, any_image &_img)
+{
+    bmp_info _info;
+    bmp_status _status = probe_bmp(_file_name, _info);
+    if (_status != bmp_status::ok)
+        return _status;
+
+    switch (_info.bit_count)
+    {
+    case 24:
+        return read_bmp(_file_name, _img.emplace<image_bgr24>());
+    case 32:
+        return read_bmp(_file_name, _img.emplace<image_bgra32>());
+    case 4:
+    case 8:
+    {
+        if (_info.bit_count == 8)
+        {
+            _status = read_bmp(_file_name, _img.emplace<image_gray8>());
+            if (_status != bmp_status::unsupported_format)
+                return _status;
+        }
+
+        palette_image _indexed;
+        _status = read_bmp(_file_name, _indexed);
+        if (_status != bmp_status::ok)
+            return _status;
+        if (is_identity_gray_palette(_indexed.palette))
+            _img = std::move(_indexed.indices);
+        else
+            _img = expand_palette(_indexed);
+        return bmp_status::ok;
+    }
+    default:
+        return bmp_status::unsupported_format;
+    }
+}
+
+/// @brief Fills in headers for an uncompressed bitmap with `_palette_entries` colours after the info header
+void make_bmp_headers(size_t _width, size_t _height, WORD _bit_count, size_t _palette_entries, BITMAPFILEHEADER &_bfh, BITMAPINFOHEADER &_bih)
+{
+    size_t _stride = ((_width * _bit_count + 31) / 32) * 4;
+    _bih = {};
+    _bih.biSize = sizeof(BITMAPINFOHEADER);
+    _bih.biWidth = static_cast<LONG>(_width);
+    _bih.biHeight = static_cast<LONG>(_height);
+    _bih.biPlanes = 1;
+    _bih.biBitCount = _bit_count;
+    _bih.biSizeImage = static_cast<DWORD>(_stride * _height);
+    _bih.biXPelsPerMeter = 2835; // 72 dpi
+    _bih.biYPelsPerMeter = 2835;
+    _bih.biClrUsed = static_cast<DWORD>(_palette_entries);
+
+    _bfh = {};
+    _bfh.bfType = 0x4d42;
+    _bfh.bfOffBits = static_cast<DWORD>(sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + _palette_entries * sizeof(RGBQUAD));
+    _bfh.bfSize = static_cast<DWORD>(_bfh.bfOffBits + _bih.biSizeImage);
+}
+
+/// @brief Writes the view as an uncompressed bottom up bitmap of the matching bit count
+/// gray8 is written as an 8 bit bitmap with a 256 entry grayscale palette
+template <class Format>
+bool write_bmp(const std::string &_file_name, const image_view<Format> &_img)
+{
+    static_assert(Format::bit_count != 0, "pixel format has no bmp equivalent");
+    std::ofstream _out_file(_file_name, std::ios_base::binary);
+    if (!_out_file.is_open())
+    {
+        std::cerr << "Can't open the output file!";
+        return false;
+    }
+
+    constexpr size_t _palette_entries = Format::is_gray ? 256 : 0;
+    BITMAPFILEHEADER _bfh;
+    BITMAPINFOHEADER _bih;
+    make_bmp_headers(_img.width(), _img.height(), Format::bit_count, _palette_entries, _bfh, _bih);
+    _out_file.write(reinterpret_cast<char *>(&_bfh), sizeof(BITMAPFILEHEADER));
+    _out_file.write(reinterpret_cast<char *>(&_bih), sizeof(BITMAPINFOHEADER));
+    if constexpr (Format::is_gray)
+    {
+        RGBQUAD _palette[_palette_entries];
+        for (size_t _i = 0; _i < _palette_entries; _i++)
+            _palette[_i] = {static_cast<BYTE>(_i), static_cast<BYTE>(_i), static_cast<BYTE>(_i), 0};
+        _out_file.write(reinterpret_cast<char *>(_palette), sizeof(_palette));
+    }
+
+    const char _padding[4] = {};
+    size_t _padding_width = _bih.biSizeImage / std::max<size_t>(_img.height(), 1) - _img.row_bytes();
+    write_behind_writer _writer(_out_file, std::min<size_t>(bmp_io_chunk_size, _bih.biSizeImage));
+    for (size_t _row = _img.height(); _row-- > 0;)
+    {
+        _writer.write(reinterpret_cast<const char *>(_img.row(_row)), _img.row_bytes());
+        _writer.write(_padding, _padding_width);
+    }
+    return _writer.flush() && _out_file.good();
+}
+
+bool bmp::write_to_file(std::string output_file_name, const image_view<pixel_format::gray8> &gray)
+{
+    return write_bmp(output_file_name, gray);
+}
+
+/// @brief Writes a 4 or 8 bit bitmap with the colour table of `_img`
+/// @param _bit_count 4 takes palettes of up to 16 colours
+/// @param _rle store the pixels BI_RLE4 or BI_RLE8 compressed, smaller for flat areas, larger for noise
+bool write_bmp(const std::string &_file_name, const palette_image &_img, WORD _bit_count = 8, bool _rle = false)
+{
+    if ((_bit_count != 4 && _bit_count != 8) || _img.palette.empty() || _img.palette.size() > (size_t(1) << _bit_count))
+    {
+        std::cerr << "A " << _bit_count << " bit bitmap can't hold a palette of " << _img.palette.size() << " colours";
+        return false;
+    }
+    const image_view<pixel_format::gray8> _indices = _img.indices.view();
+    BITMAPFILEHEADER _bfh;
+    BITMAPINFOHEADER _bih;
+    make_bmp_headers(_indices.width(), _indices.height(), _bit_count, _img.palette.size(), _bfh, _bih);
+
+    tracked_vector<BYTE> _pixels;
+    if (_rle)
+    {
+        encode_bmp_rle(_indices, _bit_count, _pixels);
+        _bih.biCompression = _bit_count == 8 ? 1 /*BI_RLE8*/ : 2 /*BI_RLE4*/;
+        _bih.biSizeImage = static_cast<DWORD>(_pixels.size());
+        _bfh.bfSize = _bfh.bfOffBits + _bih.biSizeImage;
+    }
+    else
+    {
+        size_t _stride = _bih.biSizeImage / std::max<size_t>(_indices.height(), 1);
+        _pixels.assign(_bih.biSizeImage, 0);
+        for (size_t _row = 0; _row < _indices.height(); _row++)
+        {
+            const BYTE *_src = _indices.row(_row);
+            BYTE *_dst = &_pixels[(_indices.height() - 1 - _row) * _stride];
+            if (_bit_count == 8)
+                std::memcpy(_dst, _src, _indices.width());
+            else
+                for (size_t _x = 0; _x < _indices.width(); _x++)
+                    _dst[_x / 2] |= static_cast<BYTE>((_src[_x] & 0x0f) << (_x % 2 ? 0 : 4));
+        }
+    }
+
+    std::ofstream _out_file(_file_name, std::ios_base::binary);
+    if (!_out_file.is_open())
+    {
+        std::cerr << "Can't open the output file!";
+        return false;
+    }
+    _out_file.write(reinterpret_cast<char *>(&_bfh), sizeof(BITMAPFILEHEADER));
+    _out_file.write(reinterpret_cast<char *>(&_bih), sizeof(BITMAPINFOHEADER));
+    _out_file.write(reinterpret_cast<const char *>(_img.palette.data()), _img.palette.size() * sizeof(RGBQUAD));
+    _out_file.write(reinterpret_cast<const char *>(_pixels.data()), _pixels.size());
+    return _out_file.good();
+}
+#pragma endregion
+
+#endif
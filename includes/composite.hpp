@@ -0,0 +1,206 @@
+#ifndef COMPOSITE_HPP
+#define COMPOSITE_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+#include <type_traits>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define COMPOSITE_SSE2 1
+#endif
+
+#pragma region composite
+/// @brief How a source colour S combines with the destination colour D before the source alpha mixes it in
+enum class blend_mode
+{
+    over,     // S
+    add,      // D + S * alpha, saturating, no mixing
+    multiply, // S * D / 255, darkens
+    screen    // S + D - S * D / 255, lightens
+};
+
+namespace composite_detail
+{
+    /// @brief x / 255 rounded to nearest, exact for 0 <= x <= 255 * 255
+    unsigned div255(unsigned _x)
+    {
+        _x += 128;
+        return (_x + (_x >> 8)) >> 8;
+    }
+
+    /// @brief blended colour byte, `_a` is the source alpha already scaled by the opacity
+    template <blend_mode Mode>
+    BYTE blend_byte(unsigned _s, unsigned _d, unsigned _a)
+    {
+        if constexpr (Mode == blend_mode::add)
+            return static_cast<BYTE>(std::min(255u, _d + div255(_s * _a)));
+        unsigned _b = _s;
+        if constexpr (Mode == blend_mode::multiply)
+            _b = div255(_s * _d);
+        else if constexpr (Mode == blend_mode::screen)
+            _b = _s + _d - div255(_s * _d);
+        return static_cast<BYTE>(div255(_b * _a + _d * (255 - _a)));
+    }
+
+    /// @brief destination alpha after compositing a source of alpha `_a` over it
+    BYTE blend_alpha(unsigned _d, unsigned _a)
+    {
+        return static_cast<BYTE>(div255(255 * _a + _d * (255 - _a)));
+    }
+
+#ifdef COMPOSITE_SSE2
+    __m128i div255_epi16(__m128i _x)
+    {
+        _x = _mm_add_epi16(_x, _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(_x, _mm_srli_epi16(_x, 8)), 8);
+    }
+
+    /// @brief blend_byte on eight 16 bit lanes
+    template <blend_mode Mode>
+    __m128i blend_epi16(__m128i _s, __m128i _d, __m128i _a)
+    {
+        const __m128i _full = _mm_set1_epi16(255);
+        __m128i _b = _s;
+        if constexpr (Mode == blend_mode::multiply)
+            _b = div255_epi16(_mm_mullo_epi16(_s, _d));
+        else if constexpr (Mode == blend_mode::screen)
+            _b = _mm_sub_epi16(_mm_add_epi16(_s, _d), div255_epi16(_mm_mullo_epi16(_s, _d)));
+        return div255_epi16(_mm_add_epi16(_mm_mullo_epi16(_b, _a), _mm_mullo_epi16(_d, _mm_sub_epi16(_full, _a))));
+    }
+
+    /// @brief 16 bytes of `_d` blended with `_s` under per byte alpha `_a`
+    template <blend_mode Mode>
+    __m128i blend_epi8(__m128i _s, __m128i _d, __m128i _a)
+    {
+        const __m128i _zero = _mm_setzero_si128();
+        if constexpr (Mode == blend_mode::add)
+        {
+            __m128i _lo = div255_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(_s, _zero), _mm_unpacklo_epi8(_a, _zero)));
+            __m128i _hi = div255_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(_s, _zero), _mm_unpackhi_epi8(_a, _zero)));
+            return _mm_adds_epu8(_d, _mm_packus_epi16(_lo, _hi));
+        }
+        __m128i _lo = blend_epi16<Mode>(_mm_unpacklo_epi8(_s, _zero), _mm_unpacklo_epi8(_d, _zero), _mm_unpacklo_epi8(_a, _zero));
+        __m128i _hi = blend_epi16<Mode>(_mm_unpackhi_epi8(_s, _zero), _mm_unpackhi_epi8(_d, _zero), _mm_unpackhi_epi8(_a, _zero));
+        return _mm_packus_epi16(_lo, _hi);
+    }
+
+    /// @brief every byte scaled by `_opacity` / 255
+    __m128i scale_epi8(__m128i _a, BYTE _opacity)
+    {
+        const __m128i _zero = _mm_setzero_si128(), _o = _mm_set1_epi16(_opacity);
+        __m128i _lo = div255_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(_a, _zero), _o));
+        __m128i _hi = div255_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(_a, _zero), _o));
+        return _mm_packus_epi16(_lo, _hi);
+    }
+#endif
+
+    /// @brief Composites one row of `_n` bgra32 pixels, the alpha comes from byte 3 of every source pixel
+    template <blend_mode Mode>
+    void blend_row_bgra(const BYTE *_s, BYTE *_d, size_t _n, BYTE _opacity)
+    {
+        size_t _x = 0;
+#ifdef COMPOSITE_SSE2
+        const __m128i _alpha_bytes = _mm_set1_epi32(static_cast<int>(0xff000000u));
+        for (; _x + 4 <= _n; _x += 4)
+        {
+            __m128i _sv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_s + 4 * _x));
+            __m128i _dv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_d + 4 * _x));
+            // source alpha copied into all four bytes of its pixel
+            __m128i _a = _mm_srli_epi32(_sv, 24);
+            _a = _mm_or_si128(_a, _mm_slli_epi32(_a, 8));
+            _a = _mm_or_si128(_a, _mm_slli_epi32(_a, 16));
+            if (_opacity != 255)
+                _a = scale_epi8(_a, _opacity);
+            __m128i _colour = blend_epi8<Mode>(_sv, _dv, _a);
+            // the alpha bytes composite a fully opaque source over the destination alpha
+            __m128i _alpha = blend_epi8<blend_mode::over>(_mm_or_si128(_sv, _alpha_bytes), _dv, _a);
+            _colour = _mm_or_si128(_mm_andnot_si128(_alpha_bytes, _colour), _mm_and_si128(_alpha_bytes, _alpha));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(_d + 4 * _x), _colour);
+        }
+#endif
+        for (; _x < _n; _x++)
+        {
+            const BYTE *_sp = _s + 4 * _x;
+            BYTE *_dp = _d + 4 * _x;
+            unsigned _a = div255(_sp[3] * unsigned(_opacity));
+            for (size_t _c = 0; _c < 3; _c++)
+                _dp[_c] = blend_byte<Mode>(_sp[_c], _dp[_c], _a);
+            _dp[3] = blend_alpha(_dp[3], _a);
+        }
+    }
+
+    /// @brief Composites one row of `_n` bgr24 pixels, the alpha of pixel x is `_mask[x]`
+    /// @param _alpha scratch of 3 * `_n` bytes for the alpha of every byte
+    template <blend_mode Mode>
+    void blend_row_masked(const BYTE *_s, const BYTE *_mask, BYTE *_d, size_t _n, BYTE _opacity, BYTE *_alpha)
+    {
+        for (size_t _x = 0; _x < _n; _x++)
+            _alpha[3 * _x] = _alpha[3 * _x + 1] = _alpha[3 * _x + 2] = _mask[_x];
+        size_t _i = 0, _bytes = 3 * _n;
+#ifdef COMPOSITE_SSE2
+        for (; _i + 16 <= _bytes; _i += 16)
+        {
+            __m128i _a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_alpha + _i));
+            if (_opacity != 255)
+                _a = scale_epi8(_a, _opacity);
+            __m128i _sv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_s + _i));
+            __m128i _dv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_d + _i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(_d + _i), blend_epi8<Mode>(_sv, _dv, _a));
+        }
+#endif
+        for (; _i < _bytes; _i++)
+            _d[_i] = blend_byte<Mode>(_s[_i], _d[_i], div255(_alpha[_i] * unsigned(_opacity)));
+    }
+
+    /// @brief calls `_fn(std::integral_constant<blend_mode, Mode>{})` with `_mode` as a compile time constant
+    template <class Fn>
+    void dispatch_mode(blend_mode _mode, Fn &&_fn)
+    {
+        switch (_mode)
+        {
+        case blend_mode::over:
+            return _fn(std::integral_constant<blend_mode, blend_mode::over>{});
+        case blend_mode::add:
+            return _fn(std::integral_constant<blend_mode, blend_mode::add>{});
+        case blend_mode::multiply:
+            return _fn(std::integral_constant<blend_mode, blend_mode::multiply>{});
+        case blend_mode::screen:
+            return _fn(std::integral_constant<blend_mode, blend_mode::screen>{});
+        }
+    }
+}; // namespace composite_detail
+
+/// @brief Composites `_src` onto `_dst` through the source alpha, in parallel row bands
+/// every division by 255 is rounded to nearest, the SSE2 and the scalar path give identical results. The
+/// destination colour is the backdrop the source is blended with and the destination alpha becomes
+/// a + d * (1 - a). Pass sub views to place the source, the overlapping top left part of the two is used
+/// @param _opacity scales the source alpha, 255 keeps it
+void composite(const image_view<pixel_format::bgra32> &_src, const image_view<pixel_format::bgra32> &_dst, blend_mode _mode = blend_mode::over, BYTE _opacity = 255)
+{
+    size_t _w = std::min(_src.width(), _dst.width()), _h = std::min(_src.height(), _dst.height());
+    composite_detail::dispatch_mode(_mode, [&](auto _constant)
+                                    {
+        constexpr blend_mode Mode = decltype(_constant)::value;
+        parallel_for(_h, [&](size_t _begin, size_t _end)
+                     {
+            for (size_t _y = _begin; _y < _end; _y++)
+                composite_detail::blend_row_bgra<Mode>(_src.channels(_y), _dst.channels(_y), _w, _opacity); }, 16); });
+}
+
+/// @brief Composites `_src` onto `_dst` with the alpha of every pixel taken from `_mask`
+/// rounding and placement as for bgra32, the three views are lined up at their top left corners
+void composite(const image_view<pixel_format::bgr24> &_src, const image_view<pixel_format::gray8> &_mask, const image_view<pixel_format::bgr24> &_dst, blend_mode _mode = blend_mode::over, BYTE _opacity = 255)
+{
+    size_t _w = std::min({_src.width(), _mask.width(), _dst.width()}), _h = std::min({_src.height(), _mask.height(), _dst.height()});
+    composite_detail::dispatch_mode(_mode, [&](auto _constant)
+                                    {
+        constexpr blend_mode Mode = decltype(_constant)::value;
+        parallel_for(_h, [&](size_t _begin, size_t _end)
+                     {
+            tracked_vector<BYTE> _alpha(3 * _w);
+            for (size_t _y = _begin; _y < _end; _y++)
+                composite_detail::blend_row_masked<Mode>(_src.channels(_y), _mask.channels(_y), _dst.channels(_y), _w, _opacity, _alpha.data()); }, 16); });
+}
+#pragma endregion
+
+#endif
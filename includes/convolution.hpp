@@ -0,0 +1,354 @@
+#ifndef CONVOLUTION_HPP
+#define CONVOLUTION_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+#include "math_utils.hpp"
+#include <cmath>
+#include <numeric>
+#include <type_traits>
+
+#pragma region convolution
+enum class border_mode
+{
+    zero,     // taps outside the image read 0, what the original filters did
+    replicate // taps outside the image read the nearest edge pixel
+};
+
+/// @brief Square odd sized integer kernel, out = sum(weight * in) / divisor + bias
+/// weight (row, col) multiplies the pixel (x + col - size / 2, y + row - size / 2), the kernel is not mirrored
+class convolution_kernel
+{
+private:
+    size_t m_size{};
+    std::vector<int> m_weights;
+    int m_divisor{1}, m_bias{};
+    bool m_separable{};
+    std::vector<int> m_column, m_row; // weight (r, c) = m_column[r] * m_row[c] when separable
+
+    /// @brief looks for an exact integer factorization into a column times a row
+    void find_factors()
+    {
+        m_separable = false;
+        size_t _pivot_row = 0;
+        while (_pivot_row < m_size && std::all_of(&m_weights[_pivot_row * m_size], &m_weights[(_pivot_row + 1) * m_size], [](int _w)
+                                                  { return _w == 0; }))
+            _pivot_row++;
+        if (_pivot_row == m_size)
+            return;
+
+        // the row factor is the first non zero row reduced by the gcd of its entries
+        const int *_first = &m_weights[_pivot_row * m_size];
+        int _gcd = 0;
+        for (size_t _c = 0; _c < m_size; _c++)
+            _gcd = std::gcd(_gcd, _first[_c]);
+        std::vector<int> _row(m_size), _column(m_size);
+        size_t _pivot_col = 0;
+        for (size_t _c = 0; _c < m_size; _c++)
+        {
+            _row[_c] = _first[_c] / _gcd;
+            if (_row[_c] != 0 && _row[_pivot_col] == 0)
+                _pivot_col = _c;
+        }
+        for (size_t _r = 0; _r < m_size; _r++)
+        {
+            int _w = m_weights[_r * m_size + _pivot_col];
+            if (_w % _row[_pivot_col] != 0)
+                return;
+            _column[_r] = _w / _row[_pivot_col];
+            for (size_t _c = 0; _c < m_size; _c++)
+            {
+                if (m_weights[_r * m_size + _c] != _column[_r] * _row[_c])
+                    return;
+            }
+        }
+        m_separable = true;
+        m_row = std::move(_row);
+        m_column = std::move(_column);
+    }
+
+public:
+    convolution_kernel() = default;
+
+    /// @param weights size * size values, row by row
+    convolution_kernel(size_t size, std::vector<int> weights, int divisor = 1, int bias = 0)
+        : m_size(size), m_weights(std::move(weights)), m_divisor(divisor ? divisor : 1), m_bias(bias)
+    {
+        if (m_size % 2 == 0 || m_weights.size() != m_size * m_size)
+        {
+            std::cerr << "Convolution kernels must be odd sized squares" << std::endl;
+            m_size = 0;
+            m_weights.clear();
+            return;
+        }
+        find_factors();
+    }
+
+    static convolution_kernel from_matrix(const vec_2d &_matrix, int _divisor = 1, int _bias = 0)
+    {
+        std::vector<int> _weights;
+        for (const auto &_row : _matrix)
+            _weights.insert(_weights.end(), _row.begin(), _row.end());
+        return convolution_kernel(_matrix.size(), std::move(_weights), _divisor, _bias);
+    }
+
+    static convolution_kernel sharpen() { return convolution_kernel(3, {0, -1, 0, -1, 5, -1, 0, -1, 0}); }
+    static convolution_kernel emboss() { return convolution_kernel(3, {-2, -1, 0, -1, 1, 1, 0, 1, 2}); }
+    static convolution_kernel box(size_t _size)
+    {
+        return convolution_kernel(_size, std::vector<int>(_size * _size, 1), static_cast<int>(_size * _size));
+    }
+    /// @brief separable gaussian from Gaussian::GaussianKernel1D, 8 bits per axis
+    static convolution_kernel gaussian(size_t _size, float _std = 1.0f)
+    {
+        std::vector<int> _taps = Gaussian::GaussianKernel1D(static_cast<int>(_size), _std, 8), _weights;
+        for (int _a : _taps)
+            for (int _b : _taps)
+                _weights.push_back(_a * _b);
+        return convolution_kernel(_size, std::move(_weights), 1 << 16);
+    }
+
+    size_t size() const { return m_size; }
+    int weight(size_t _row, size_t _col) const { return m_weights[_row * m_size + _col]; }
+    const int *weights() const { return m_weights.data(); }
+    int divisor() const { return m_divisor; }
+    int bias() const { return m_bias; }
+    bool separable() const { return m_separable; }
+    const std::vector<int> &row_factors() const { return m_row; }
+    const std::vector<int> &column_factors() const { return m_column; }
+
+    /// @brief largest magnitude any partial sum reaches per unit of input
+    int64_t gain() const
+    {
+        int64_t _direct = 0, _row = 0, _column = 0;
+        for (int _w : m_weights)
+            _direct += std::abs(_w);
+        if (!m_separable)
+            return _direct;
+        for (size_t _i = 0; _i < m_size; _i++)
+        {
+            _row += std::abs(m_row[_i]);
+            _column += std::abs(m_column[_i]);
+        }
+        return std::max(_direct, _row * _column);
+    }
+};
+
+namespace convolution_detail
+{
+    /// @brief Produces the accumulator rows of one kernel over an image, for a band of consecutive output rows
+    /// source rows are padded by size / 2 pixels on both sides once, so every tap is a multiply add over a
+    /// contiguous run with no bounds checks. Separable kernels keep a ring of horizontally filtered rows and
+    /// finish with one vertical pass. N is the kernel size when known at compile time, 0 for any size
+    template <size_t N, class Acc, class Format>
+    class row_convolver
+    {
+    private:
+        const image_view<Format> &m_src;
+        const convolution_kernel &m_kernel;
+        border_mode m_border;
+        size_t m_n, m_radius, m_row, m_padded;
+        tracked_vector<Acc> m_source_ring, m_filtered_ring, m_acc;
+        std::vector<long> m_source_held, m_filtered_held;
+
+        size_t size() const { return N ? N : m_n; }
+
+        /// @brief source row `_sy` padded and widened to Acc, nullptr when it is outside with a zero border
+        const Acc *source_row(long _sy)
+        {
+            const long _h = static_cast<long>(m_src.height());
+            if (_sy < 0 || _sy >= _h)
+            {
+                if (m_border == border_mode::zero)
+                    return nullptr;
+                _sy = std::clamp(_sy, 0l, _h - 1);
+            }
+            size_t _slot = static_cast<size_t>(_sy) % size();
+            Acc *_out = &m_source_ring[_slot * m_padded];
+            if (m_source_held[_slot] == _sy)
+                return _out;
+            m_source_held[_slot] = _sy;
+
+            constexpr size_t _c = Format::channels;
+            const auto *_in = m_src.channels(static_cast<size_t>(_sy));
+            const size_t _pad = m_radius * _c;
+            for (size_t _i = 0; _i < m_row; _i++)
+                _out[_pad + _i] = static_cast<Acc>(_in[_i]);
+            for (size_t _x = 0; _x < m_radius; _x++)
+            {
+                for (size_t _ch = 0; _ch < _c; _ch++)
+                {
+                    bool _zero = m_border == border_mode::zero;
+                    _out[_x * _c + _ch] = _zero ? 0 : static_cast<Acc>(_in[_ch]);
+                    _out[_pad + m_row + _x * _c + _ch] = _zero ? 0 : static_cast<Acc>(_in[m_row - _c + _ch]);
+                }
+            }
+            return _out;
+        }
+
+        /// @brief `_out`[i] += sum of `_taps`[k] * `_in`[i + k * channels]
+        void taps_row(const Acc *_in, const int *_taps, Acc *_out) const
+        {
+            constexpr size_t _c = Format::channels;
+            for (size_t _k = 0; _k < size(); _k++)
+            {
+                const Acc _w = static_cast<Acc>(_taps[_k]);
+                if (_w == 0)
+                    continue;
+                const Acc *_p = _in + _k * _c;
+                for (size_t _i = 0; _i < m_row; _i++)
+                    _out[_i] += _w * _p[_i];
+            }
+        }
+
+        const Acc *filtered_row(long _sy)
+        {
+            const Acc *_in = source_row(_sy);
+            if (!_in)
+                return nullptr;
+            long _key = std::clamp(_sy, 0l, static_cast<long>(m_src.height()) - 1);
+            size_t _slot = static_cast<size_t>(_key) % size();
+            Acc *_out = &m_filtered_ring[_slot * m_row];
+            if (m_filtered_held[_slot] == _key)
+                return _out;
+            m_filtered_held[_slot] = _key;
+            std::fill(_out, _out + m_row, 0);
+            taps_row(_in, m_kernel.row_factors().data(), _out);
+            return _out;
+        }
+
+    public:
+        row_convolver(const image_view<Format> &src, const convolution_kernel &kernel, border_mode border)
+            : m_src(src), m_kernel(kernel), m_border(border), m_n(kernel.size()), m_radius(kernel.size() / 2)
+        {
+            constexpr size_t _c = Format::channels;
+            m_row = m_src.width() * _c;
+            m_padded = m_row + 2 * m_radius * _c;
+            m_source_ring.resize(size() * m_padded);
+            m_source_held.assign(size(), -1);
+            if (m_kernel.separable())
+            {
+                m_filtered_ring.resize(size() * m_row);
+                m_filtered_held.assign(size(), -1);
+            }
+            m_acc.resize(m_row);
+        }
+
+        /// @brief accumulators of output row `_y`, width * channels values before the divisor and bias
+        const Acc *row(size_t _y)
+        {
+            std::fill(m_acc.begin(), m_acc.end(), 0);
+            for (size_t _k = 0; _k < size(); _k++)
+            {
+                long _sy = static_cast<long>(_y + _k) - static_cast<long>(m_radius);
+                if (m_kernel.separable())
+                {
+                    const Acc _w = static_cast<Acc>(m_kernel.column_factors()[_k]);
+                    const Acc *_in = _w ? filtered_row(_sy) : nullptr;
+                    if (!_in)
+                        continue;
+                    for (size_t _i = 0; _i < m_row; _i++)
+                        m_acc[_i] += _w * _in[_i];
+                }
+                else
+                {
+                    const Acc *_in = source_row(_sy);
+                    if (_in)
+                        taps_row(_in, m_kernel.weights() + _k * size(), m_acc.data());
+                }
+            }
+            return m_acc.data();
+        }
+    };
+
+    /// @brief calls `_fn` with std::integral_constant of the kernel size for the unrolled sizes, 0 otherwise
+    template <class Fn>
+    void dispatch_size(size_t _size, Fn &&_fn)
+    {
+        switch (_size)
+        {
+        case 3:
+            _fn(std::integral_constant<size_t, 3>());
+            break;
+        case 5:
+            _fn(std::integral_constant<size_t, 5>());
+            break;
+        case 7:
+            _fn(std::integral_constant<size_t, 7>());
+            break;
+        default:
+            _fn(std::integral_constant<size_t, 0>());
+            break;
+        }
+    }
+}; // namespace convolution_detail
+
+/// @brief Convolves `_src` into `_dst` of the same size, every channel separately, they must not overlap
+/// accumulators are int32, or int16 for 8 bit images when the kernel gain allows it which doubles the lanes per
+/// vector, or int64 for 16 bit images with kernels large enough to overflow int32
+template <class Format>
+void convolve(const image_view<Format> &_src, const image_view<Format> &_dst, const convolution_kernel &_kernel, border_mode _border = border_mode::zero)
+{
+    using channel = typename Format::channel;
+    if (_kernel.size() == 0 || _src.empty())
+        return;
+    constexpr int64_t _max = std::numeric_limits<channel>::max();
+    const bool _narrow = sizeof(channel) == 1 && _kernel.gain() * _max <= INT16_MAX;
+    const bool _wide = _kernel.gain() * _max > INT32_MAX;
+
+    auto _run = [&](auto _acc_tag, auto _size)
+    {
+        using acc_t = decltype(_acc_tag);
+        parallel_for(_src.height(), [&](size_t _begin, size_t _end)
+                     {
+            convolution_detail::row_convolver<decltype(_size)::value, acc_t, Format> _conv(_src, _kernel, _border);
+            for (size_t _y = _begin; _y < _end; _y++)
+            {
+                const acc_t *_acc = _conv.row(_y);
+                channel *_out = _dst.channels(_y);
+                for (size_t _i = 0; _i < _src.width() * Format::channels; _i++)
+                    _out[_i] = static_cast<channel>(std::clamp<int64_t>(int64_t(_acc[_i]) / _kernel.divisor() + _kernel.bias(), 0, _max));
+            } }, 16);
+    };
+    convolution_detail::dispatch_size(_kernel.size(), [&](auto _size)
+                                      {
+        if (_narrow)
+            _run(int16_t(), _size);
+        else if (_wide)
+            _run(int64_t(), _size);
+        else
+            _run(int32_t(), _size); });
+}
+
+/// @brief sqrt(gx^2 + gy^2) of two equally sized kernels clamped to the channel range, e.g. for edge maps
+template <class Format>
+void gradient_magnitude(const image_view<Format> &_src, const image_view<Format> &_dst, const convolution_kernel &_kx, const convolution_kernel &_ky, border_mode _border = border_mode::zero)
+{
+    using channel = typename Format::channel;
+    if (_kx.size() != _ky.size())
+    {
+        std::cerr << "Gradient kernels must have the same size" << std::endl;
+        return;
+    }
+    if (_kx.size() == 0 || _src.empty())
+        return;
+    constexpr int64_t _max = std::numeric_limits<channel>::max();
+
+    convolution_detail::dispatch_size(_kx.size(), [&](auto _size)
+                                      { parallel_for(_src.height(), [&](size_t _begin, size_t _end)
+                                                     {
+        convolution_detail::row_convolver<decltype(_size)::value, int32_t, Format> _conv_x(_src, _kx, _border), _conv_y(_src, _ky, _border);
+        for (size_t _y = _begin; _y < _end; _y++)
+        {
+            const int32_t *_gx = _conv_x.row(_y), *_gy = _conv_y.row(_y);
+            channel *_out = _dst.channels(_y);
+            for (size_t _i = 0; _i < _src.width() * Format::channels; _i++)
+            {
+                int64_t _sq = int64_t(_gx[_i] / _kx.divisor()) * (_gx[_i] / _kx.divisor()) + int64_t(_gy[_i] / _ky.divisor()) * (_gy[_i] / _ky.divisor());
+                _out[_i] = static_cast<channel>(std::min<int64_t>(static_cast<int64_t>(std::sqrt(static_cast<double>(_sq))), _max));
+            }
+        } }, 16); });
+}
+#pragma endregion
+
+#endif
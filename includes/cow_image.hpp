@@ -0,0 +1,166 @@
+#ifndef COW_IMAGE_HPP
+#define COW_IMAGE_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+
+#pragma region cow_image
+/// @brief Image handle whose rows live in bands of `band_rows` rows shared between copies of the handle
+/// copying a handle copies only the band pointers. The first write to a band that another handle still sees
+/// copies that band alone, so a snapshot of a large image costs memory only for the bands edited after it.
+/// A handle must be used by one thread at a time, different handles sharing bands may be used concurrently
+template <class Format>
+class cow_image
+{
+public:
+    using pixel = typename Format::pixel;
+    static constexpr size_t default_band_rows = 64;
+
+private:
+    size_t m_width{}, m_height{}, m_band_rows{default_band_rows};
+    std::vector<std::shared_ptr<image<Format>>> m_bands;
+
+    /// @brief makes band `_b` private to this handle, copying it when it is shared
+    image<Format> &detach(size_t _b)
+    {
+        std::shared_ptr<image<Format>> &_band = m_bands[_b];
+        if (_band.use_count() > 1)
+            _band = std::make_shared<image<Format>>(*_band);
+        return *_band;
+    }
+
+public:
+    cow_image() = default;
+
+    /// @brief blank image
+    cow_image(size_t width, size_t height, size_t band_rows = default_band_rows)
+        : m_width(width), m_height(height), m_band_rows(std::max<size_t>(band_rows, 1))
+    {
+        for (size_t _y = 0; _y < m_height; _y += m_band_rows)
+            m_bands.push_back(std::make_shared<image<Format>>(m_width, std::min(m_band_rows, m_height - _y)));
+    }
+
+    /// @brief copies the pixels of `src`, the only full copy a handle ever makes
+    cow_image(const image_view<Format> &src, size_t band_rows = default_band_rows) : cow_image(src.width(), src.height(), band_rows)
+    {
+        for (size_t _b = 0; _b < m_bands.size(); _b++)
+            copy_pixels(src.sub_view(0, _b * m_band_rows, m_width, m_bands[_b]->height()), m_bands[_b]->view());
+    }
+
+    size_t width() const { return m_width; }
+    size_t height() const { return m_height; }
+    size_t band_rows() const { return m_band_rows; }
+    size_t bands() const { return m_bands.size(); }
+
+    const pixel *row(size_t _y) const { return m_bands[_y / m_band_rows]->row(_y % m_band_rows); }
+    const pixel &at(size_t _x, size_t _y) const { return row(_y)[_x]; }
+
+    /// @brief row `_y` for writing, its band is copied first if shared
+    pixel *writable_row(size_t _y) { return detach(_y / m_band_rows).row(_y % m_band_rows); }
+
+    /// @brief band `_b` for reading, callers must not write through it
+    image_view<Format> band(size_t _b) const { return m_bands[_b]->view(); }
+
+    /// @brief band `_b` for writing, copied first if shared
+    image_view<Format> writable_band(size_t _b) { return detach(_b).view(); }
+
+    /// @brief Calls `_fn(view, rect)` for the part of `_rect` in every band it crosses, after making those
+    /// bands private, `rect` is the position of the view in the image
+    /// @note only for pointwise edits. A view ends at its band so a filter reading neighbours sees a clamped
+    /// border at every band edge, use modify_neighbourhood for those
+    template <class Fn>
+    void modify(const image_rect &_rect, Fn &&_fn)
+    {
+        image_rect _r = _rect.intersected({0, 0, m_width, m_height});
+        if (_r.empty())
+            return;
+        for (size_t _b = _r.y / m_band_rows; _b * m_band_rows < _r.bottom(); _b++)
+        {
+            image_rect _part = _r.intersected({0, _b * m_band_rows, m_width, m_bands[_b]->height()});
+            image_view<Format> _view = writable_band(_b).sub_view(_part.x, _part.y - _b * m_band_rows, _part.width, _part.height);
+            _fn(_view, _part);
+        }
+    }
+
+    /// @brief Runs a filter reading up to `_halo` pixels around every output pixel over `_rect`
+    /// calls `_fn(src, dst)` once per band crossed by `_rect` with two images of the band's part of `_rect` grown
+    /// by `_halo` and clipped to the image. `src` holds the pixels from before the call, whatever band they are
+    /// in, `_fn` fills `dst` and the part inside `_rect` is written back. Only the image edges are borders
+    template <class Fn>
+    void modify_neighbourhood(const image_rect &_rect, size_t _halo, Fn &&_fn)
+    {
+        image_rect _r = _rect.intersected({0, 0, m_width, m_height});
+        if (_r.empty())
+            return;
+        // bands are written top to bottom, so the only pixels from before the call that a band can no longer
+        // supply are the last `_halo` rows already written. Those are kept aside, every other row comes from the bands
+        image<Format> _kept(0, 0);
+        size_t _kept_y = _r.y;
+        for (size_t _b = _r.y / m_band_rows; _b * m_band_rows < _r.bottom(); _b++)
+        {
+            image_rect _part = _r.intersected({0, _b * m_band_rows, m_width, m_bands[_b]->height()});
+            image_rect _grown = _part.expanded(_halo, m_width, m_height);
+            image<Format> _src(_grown.width, _grown.height), _dst(_grown.width, _grown.height);
+            auto _read_bands = [&](size_t _y0, size_t _y1)
+            {
+                for (size_t _k = _y0 / m_band_rows; _y0 < _y1 && _k * m_band_rows < _y1; _k++)
+                {
+                    image_rect _overlap = image_rect{_grown.x, _y0, _grown.width, _y1 - _y0}.intersected({0, _k * m_band_rows, m_width, m_bands[_k]->height()});
+                    copy_pixels(band(_k).sub_view(_overlap.x, _overlap.y - _k * m_band_rows, _overlap.width, _overlap.height),
+                                _src.view().sub_view(0, _overlap.y - _grown.y, _overlap.width, _overlap.height));
+                }
+            };
+            // rows [_grown.y, _kept_y) are only above the first band and were never written
+            _read_bands(_grown.y, _kept_y);
+            copy_pixels(_kept.view(), _src.view().sub_view(0, _kept_y - _grown.y, _grown.width, _part.y - _kept_y));
+            _read_bands(_part.y, _grown.bottom());
+            _fn(_src.view(), _dst.view());
+
+            size_t _next_y = std::max(_grown.y, _part.bottom() - std::min(_halo, _part.bottom()));
+            _kept = image<Format>(_grown.width, _part.bottom() - _next_y);
+            copy_pixels(_src.view().sub_view(0, _next_y - _grown.y, _grown.width, _kept.height()), _kept.view());
+            _kept_y = _next_y;
+            copy_pixels(_dst.view().sub_view(_part.x - _grown.x, _part.y - _grown.y, _part.width, _part.height),
+                        writable_band(_b).sub_view(_part.x, _part.y - _b * m_band_rows, _part.width, _part.height));
+        }
+    }
+
+    /// @brief Calls `_fn(view, rect)` with every band for reading
+    template <class Fn>
+    void for_each_band(Fn &&_fn) const
+    {
+        for (size_t _b = 0; _b < m_bands.size(); _b++)
+            _fn(band(_b), image_rect{0, _b * m_band_rows, m_width, m_bands[_b]->height()});
+    }
+
+    /// @brief contiguous copy of the pixels
+    image<Format> flatten() const
+    {
+        image<Format> _img(m_width, m_height);
+        for_each_band([&](const image_view<Format> &_band, const image_rect &_rect)
+                      { copy_pixels(_band, _img.view().sub_view(_rect)); });
+        return _img;
+    }
+
+    /// @brief number of bands held in the same memory as `_other`
+    size_t shared_bands(const cow_image &_other) const
+    {
+        size_t _shared = 0;
+        for (size_t _b = 0; _b < std::min(m_bands.size(), _other.m_bands.size()); _b++)
+            _shared += m_bands[_b] == _other.m_bands[_b];
+        return _shared;
+    }
+
+    /// @brief bytes of pixel storage owned by this handle alone
+    size_t unique_bytes() const
+    {
+        size_t _bytes = 0;
+        for (const auto &_band : m_bands)
+            if (_band.use_count() == 1)
+                _bytes += static_cast<size_t>(_band->stride()) * _band->height();
+        return _bytes;
+    }
+};
+#pragma endregion
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef FILTER_CHAIN_HPP
+#define FILTER_CHAIN_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+#include "convolution.hpp"
+#include "median_filter.hpp"
+#include "morphology.hpp"
+#include "lut.hpp"
+#include <functional>
+
+#pragma region filter_chain
+/// @brief Sequence of local filters that keeps the output of every stage, so after an edit only the pixels
+/// the edit can reach are computed again
+/// A stage declares its support radius: an output pixel may depend on input pixels at most that far away.
+/// A dirty rectangle grows by each radius on its way down the chain. Every stage runs on a sub view of its
+/// input that is one radius larger than the region it has to produce, and only the inner region is kept, so
+/// the sub view edges never leak into the result. Global operations such as histogram equalization have no
+/// finite radius and don't belong in a chain
+template <class Format>
+class filter_chain
+{
+public:
+    /// @brief reads the whole of `src` and writes the whole of `dst`, both the same size and not overlapping
+    using stage_fn = std::function<void(const image_view<Format> &, const image_view<Format> &)>;
+
+private:
+    struct stage
+    {
+        size_t radius;
+        stage_fn fn;
+        image<Format> output;
+    };
+    std::vector<stage> m_stages;
+    size_t m_width{}, m_height{};
+    bool m_valid{};
+
+    /// @brief recomputes `_region` of stage `_s` from `_input`
+    void run_region(stage &_s, const image_view<Format> &_input, const image_rect &_region)
+    {
+        image_view<Format> _out = _s.output.view().sub_view(_region);
+        if (_s.radius == 0)
+        {
+            _s.fn(_input.sub_view(_region), _out);
+            return;
+        }
+        image_rect _support = _region.expanded(_s.radius, m_width, m_height);
+        image<Format> _scratch(_support.width, _support.height);
+        _s.fn(_input.sub_view(_support), _scratch.view());
+        copy_pixels(_scratch.view().sub_view(_region.x - _support.x, _region.y - _support.y, _region.width, _region.height), _out);
+    }
+
+public:
+    filter_chain &add(size_t _radius, stage_fn _fn)
+    {
+        m_stages.push_back({_radius, std::move(_fn), {}});
+        m_valid = false;
+        return *this;
+    }
+
+    filter_chain &add_convolution(const convolution_kernel &_kernel, border_mode _border = border_mode::zero)
+    {
+        return add(_kernel.size() / 2, [=](const image_view<Format> &_src, const image_view<Format> &_dst)
+                   { convolve(_src, _dst, _kernel, _border); });
+    }
+
+    filter_chain &add_gradient(const convolution_kernel &_kx, const convolution_kernel &_ky, border_mode _border = border_mode::zero)
+    {
+        return add(_kx.size() / 2, [=](const image_view<Format> &_src, const image_view<Format> &_dst)
+                   { gradient_magnitude(_src, _dst, _kx, _ky, _border); });
+    }
+
+    filter_chain &add_median(size_t _radius)
+    {
+        return add(_radius, [=](const image_view<Format> &_src, const image_view<Format> &_dst)
+                   { median_filter(_src, _dst, _radius); });
+    }
+
+    filter_chain &add_morphology(morph_op _op, size_t _w, size_t _h)
+    {
+        // open and close run two passes, each reaching half the element
+        size_t _radius = std::max(_w, _h) / 2 * (_op == morph_op::open || _op == morph_op::close ? 2 : 1);
+        return add(_radius, [=](const image_view<Format> &_src, const image_view<Format> &_dst)
+                   { morphology(_src, _dst, _op, _w, _h); });
+    }
+
+    filter_chain &add_lut(const lut_plan &_plan)
+    {
+        return add(0, [=](const image_view<Format> &_src, const image_view<Format> &_dst)
+                   {
+            copy_pixels(_src, _dst);
+            _plan.apply(_dst); });
+    }
+
+    size_t stages() const { return m_stages.size(); }
+
+    /// @brief distance over which an input pixel can change the final output
+    size_t radius() const
+    {
+        size_t _total = 0;
+        for (const stage &_s : m_stages)
+            _total += _s.radius;
+        return _total;
+    }
+
+    /// @brief Runs every stage over the whole image
+    void run(const image_view<Format> &_src)
+    {
+        m_width = _src.width();
+        m_height = _src.height();
+        const image_rect _all{0, 0, m_width, m_height};
+        image_view<Format> _input = _src;
+        for (stage &_s : m_stages)
+        {
+            _s.output = image<Format>(m_width, m_height);
+            run_region(_s, _input, _all);
+            _input = _s.output.view();
+        }
+        m_valid = true;
+    }
+
+    /// @brief Recomputes the output after the pixels in `_dirty` of `_src` changed
+    /// falls back to a full run when the chain or the image size changed since the last run
+    /// @return regions of the output that were written
+    std::vector<image_rect> update(const image_view<Format> &_src, std::vector<image_rect> _dirty)
+    {
+        const image_rect _all{0, 0, _src.width(), _src.height()};
+        if (!m_valid || _src.width() != m_width || _src.height() != m_height)
+        {
+            run(_src);
+            return {_all};
+        }
+        image_view<Format> _input = _src;
+        for (stage &_s : m_stages)
+        {
+            for (image_rect &_rect : _dirty)
+            {
+                _rect = _rect.intersected(_all);
+                if (_rect.empty())
+                    continue;
+                _rect = _rect.expanded(_s.radius, m_width, m_height);
+                run_region(_s, _input, _rect);
+            }
+            _input = _s.output.view();
+        }
+        _dirty.erase(std::remove_if(_dirty.begin(), _dirty.end(), [](const image_rect &_rect)
+                                    { return _rect.empty(); }),
+                     _dirty.end());
+        return _dirty;
+    }
+
+    /// @brief result of the last stage, the source itself is not kept so an empty chain has no output
+    image_view<Format> output() const
+    {
+        return m_stages.empty() ? image_view<Format>() : m_stages.back().output.view();
+    }
+};
+#pragma endregion
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef FRAME_PIPELINE_HPP
+#define FRAME_PIPELINE_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+#include "bmp.hpp"
+#include <functional>
+
+#pragma region frame_pipeline
+/// @brief Fixed set of images handed out and taken back through a lock free queue
+/// images keep their storage between frames, read_bmp reuses it when the next frame has the same layout
+template <class Format>
+class image_pool
+{
+private:
+    std::vector<std::unique_ptr<image<Format>>> m_images;
+    blocking_queue<image<Format> *> m_free;
+
+public:
+    explicit image_pool(size_t count) : m_free(count)
+    {
+        for (size_t _i = 0; _i < count; _i++)
+        {
+            m_images.push_back(std::make_unique<image<Format>>());
+            m_free.try_push(m_images.back().get());
+        }
+    }
+
+    /// @brief an image from the pool, sleeps until one is released when all are in use
+    image<Format> *acquire()
+    {
+        image<Format> *_img;
+        m_free.pop(_img);
+        return _img;
+    }
+
+    void release(image<Format> *_img) { m_free.try_push(_img); }
+    size_t size() const { return m_images.size(); }
+};
+
+/// @brief input and output file of one frame
+struct frame_job
+{
+    std::string input;
+    std::string output;
+};
+
+/// @brief Jobs for numbered frames, the patterns take the frame number printf style e.g. "in/frame_%05zu.bmp"
+std::vector<frame_job> numbered_frames(const std::string &_input_pattern, const std::string &_output_pattern, size_t _first, size_t _count)
+{
+    auto _format = [](const std::string &_pattern, size_t _n)
+    {
+        std::vector<char> _buffer(_pattern.size() + 32);
+        std::snprintf(_buffer.data(), _buffer.size(), _pattern.c_str(), _n);
+        return std::string(_buffer.data());
+    };
+    std::vector<frame_job> _jobs;
+    for (size_t _n = _first; _n < _first + _count; _n++)
+        _jobs.push_back({_format(_input_pattern, _n), _format(_output_pattern, _n)});
+    return _jobs;
+}
+
+struct pipeline_stats
+{
+    size_t written{};
+    size_t failed{};
+};
+
+/// @brief Decodes, filters and encodes a sequence of bitmaps with every stage on its own threads
+/// Stages hand frames over through bounded lock free queues and sleep while the queue they wait on is empty or
+/// full. A full queue holds the stage before it back, so at most the pool size of frames is in flight. Frames
+/// finish out of order, each goes to its own file
+template <class Format>
+class frame_pipeline
+{
+public:
+    /// @brief filter applied in place to every decoded frame
+    using filter_fn = std::function<void(const image_view<Format> &)>;
+
+private:
+    struct frame
+    {
+        const frame_job *job;
+        image<Format> *img;
+    };
+
+    filter_fn m_filter;
+    size_t m_decoders, m_filters, m_encoders, m_queue_depth;
+
+    /// @brief runs `_count` threads of `_body`, each counts itself in `_done` when it returns and wakes the
+    /// consumers sleeping on `_output`, the queue the stage fills, if any
+    template <class Body>
+    static void start_stage(std::vector<std::thread> &_threads, size_t _count, std::atomic<size_t> &_done, blocking_queue<frame> *_output, Body _body)
+    {
+        for (size_t _i = 0; _i < _count; _i++)
+            _threads.emplace_back([&_done, _output, _body]() mutable
+                                  {
+                _body();
+                _done.fetch_add(1, std::memory_order_release);
+                if (_output)
+                    _output->notify(); });
+    }
+
+    /// @brief pops frames until `_queue` is empty and all `_producers` of it have finished, sleeping while it is empty
+    template <class Fn>
+    static void drain(blocking_queue<frame> &_queue, const std::atomic<size_t> &_finished, size_t _producers, Fn &&_fn)
+    {
+        frame _frame;
+        while (_queue.pop_unless(_frame, [&]
+                                 { return _finished.load(std::memory_order_acquire) == _producers; }))
+            _fn(_frame);
+    }
+
+public:
+    /// @param filters threads running the filter, 0 leaves the cores the io stages don't use
+    frame_pipeline(filter_fn filter, size_t decoders = 1, size_t filters = 0, size_t encoders = 1, size_t queue_depth = 4)
+        : m_filter(std::move(filter)), m_decoders(std::max<size_t>(decoders, 1)), m_encoders(std::max<size_t>(encoders, 1)), m_queue_depth(std::max<size_t>(queue_depth, 1))
+    {
+        size_t _cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+        m_filters = filters ? filters : std::max<size_t>(1, _cores > m_decoders + m_encoders ? _cores - m_decoders - m_encoders : 1);
+    }
+
+    /// @brief processes every job, a frame that can't be read or written or whose filter throws is counted as failed
+    pipeline_stats run(const std::vector<frame_job> &_jobs)
+    {
+        image_pool<Format> _pool(2 * m_queue_depth + m_decoders + m_filters + m_encoders);
+        blocking_queue<frame> _decoded(m_queue_depth), _filtered(m_queue_depth);
+        std::atomic<size_t> _next_job{0}, _decoders_done{0}, _filters_done{0}, _encoders_done{0};
+        std::atomic<size_t> _written{0}, _failed{0};
+        std::vector<std::thread> _threads;
+
+        // runs one step of a frame, an exception fails that frame alone: it is reported and counted and its
+        // image goes back to the pool, the stage carries on with the next frame
+        auto _guarded = [&](const frame &_frame, auto &&_step)
+        {
+            try
+            {
+                _step();
+                return true;
+            }
+            catch (const std::exception &_e)
+            {
+                std::cerr << "Frame " << _frame.job->input << " failed: " << _e.what() << std::endl;
+            }
+            catch (...)
+            {
+                std::cerr << "Frame " << _frame.job->input << " failed" << std::endl;
+            }
+            _failed++;
+            _pool.release(_frame.img);
+            return false;
+        };
+
+        start_stage(_threads, m_decoders, _decoders_done, &_decoded, [&]
+                    {
+            for (size_t _i; (_i = _next_job.fetch_add(1)) < _jobs.size();)
+            {
+                frame _frame{&_jobs[_i], _pool.acquire()};
+                bmp_status _status{};
+                if (!_guarded(_frame, [&]
+                              { _status = read_bmp(_frame.job->input, *_frame.img); }))
+                    continue;
+                if (_status != bmp_status::ok)
+                {
+                    std::cerr << "Can't read " << _frame.job->input << ": " << to_string(_status) << std::endl;
+                    _failed++;
+                    _pool.release(_frame.img);
+                    continue;
+                }
+                _decoded.push(_frame);
+            } });
+
+        start_stage(_threads, m_filters, _filters_done, &_filtered, [&]
+                    { drain(_decoded, _decoders_done, m_decoders, [&](frame &_frame)
+                            {
+                if (!m_filter || _guarded(_frame, [&]
+                                          { m_filter(_frame.img->view()); }))
+                    _filtered.push(_frame); }); });
+
+        start_stage(_threads, m_encoders, _encoders_done, nullptr, [&]
+                    { drain(_filtered, _filters_done, m_filters, [&](frame &_frame)
+                            {
+                bool _ok = false;
+                if (!_guarded(_frame, [&]
+                              { _ok = write_bmp(_frame.job->output, _frame.img->view()); }))
+                    return;
+                if (_ok)
+                    _written++;
+                else
+                    _failed++;
+                _pool.release(_frame.img); }); });
+
+        for (auto &_thread : _threads)
+            _thread.join();
+        return {_written.load(), _failed.load()};
+    }
+};
+#pragma endregion
+
+#endif
@@ -0,0 +1,274 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+#include "lut.hpp"
+#include <array>
+#include <mutex>
+
+#pragma region histogram
+using histogram_bins = std::array<uint64_t, 256>;
+
+namespace histogram_detail
+{
+    /// @brief BT.601 luma in 8 bit fixed point, the weights sum to 256
+    template <class Format>
+    BYTE luminance(const BYTE *_px)
+    {
+        if constexpr (Format::is_gray)
+            return _px[0];
+        else
+            return static_cast<BYTE>((77u * _px[Format::red] + 150u * _px[Format::green] + 29u * _px[Format::blue] + 128) >> 8);
+    }
+
+    /// @brief Counts with private bins per parallel_for chunk, added into `_total` once per chunk
+    template <size_t Count, class Fill>
+    void parallel_count(size_t _rows, std::array<histogram_bins, Count> &_total, Fill &&_fill)
+    {
+        for (histogram_bins &_bins : _total)
+            _bins.fill(0);
+        std::mutex _merge;
+        parallel_for(_rows, [&](size_t _begin, size_t _end)
+                     {
+            std::array<histogram_bins, Count> _local{};
+            for (size_t _y = _begin; _y < _end; _y++)
+                _fill(_y, _local);
+            std::lock_guard<std::mutex> _lock(_merge);
+            for (size_t _c = 0; _c < Count; _c++)
+                for (size_t _i = 0; _i < 256; _i++)
+                    _total[_c][_i] += _local[_c][_i]; }, 32);
+    }
+}; // namespace histogram_detail
+
+/// @brief One histogram per channel in memory order, e.g. blue, green, red for bgr24
+template <class Format>
+std::array<histogram_bins, Format::channels> channel_histograms(const image_view<Format> &_img)
+{
+    static_assert(sizeof(typename Format::channel) == 1, "histograms have 256 bins");
+    constexpr size_t _c = Format::channels;
+    std::array<histogram_bins, _c> _hist;
+    histogram_detail::parallel_count(_img.height(), _hist, [&](size_t _y, std::array<histogram_bins, _c> &_bins)
+                                     {
+        const BYTE *_px = _img.channels(_y);
+        for (size_t _x = 0; _x < _img.width(); _x++, _px += _c)
+            for (size_t _ch = 0; _ch < _c; _ch++)
+                _bins[_ch][_px[_ch]]++; });
+    return _hist;
+}
+
+/// @brief Histogram of BT.601 luma, or of the values themselves for gray images
+template <class Format>
+histogram_bins luminance_histogram(const image_view<Format> &_img)
+{
+    static_assert(sizeof(typename Format::channel) == 1, "histograms have 256 bins");
+    std::array<histogram_bins, 1> _hist;
+    histogram_detail::parallel_count(_img.height(), _hist, [&](size_t _y, std::array<histogram_bins, 1> &_bins)
+                                     {
+        const BYTE *_px = _img.channels(_y);
+        for (size_t _x = 0; _x < _img.width(); _x++, _px += Format::channels)
+            _bins[0][histogram_detail::luminance<Format>(_px)]++; });
+    return _hist[0];
+}
+
+/// @brief Table spreading the cumulative histogram evenly over 0..255, the lowest occupied bin maps to 0
+byte_lut equalization_lut(const histogram_bins &_hist)
+{
+    byte_lut _lut;
+    uint64_t _total = 0, _first = 0;
+    for (uint64_t _count : _hist)
+        _total += _count;
+    for (uint64_t _count : _hist)
+    {
+        if (_count)
+        {
+            _first = _count;
+            break;
+        }
+    }
+    uint64_t _cdf = 0;
+    for (size_t _i = 0; _i < 256; _i++)
+    {
+        _cdf += _hist[_i];
+        // a single valued image has nothing to spread, keep it as it is
+        _lut[_i] = _total == _first ? static_cast<BYTE>(_i) : static_cast<BYTE>(_cdf < _first ? 0 : ((_cdf - _first) * 255 + (_total - _first) / 2) / (_total - _first));
+    }
+    return _lut;
+}
+
+/// @brief Table stretching [low, high] linearly over 0..255, where `_clip_percent` of the pixels
+/// fall below low and as many above high
+byte_lut stretch_lut(const histogram_bins &_hist, double _clip_percent = 0.0)
+{
+    byte_lut _lut;
+    uint64_t _total = 0;
+    for (uint64_t _count : _hist)
+        _total += _count;
+    uint64_t _clip = static_cast<uint64_t>(_total * _clip_percent / 100.0);
+
+    size_t _low = 0, _high = 255;
+    for (uint64_t _seen = 0; _low < 255 && _seen + _hist[_low] <= _clip; _low++)
+        _seen += _hist[_low];
+    for (uint64_t _seen = 0; _high > 0 && _seen + _hist[_high] <= _clip; _high--)
+        _seen += _hist[_high];
+
+    for (size_t _i = 0; _i < 256; _i++)
+    {
+        if (_high <= _low)
+            _lut[_i] = static_cast<BYTE>(_i);
+        else if (_i <= _low)
+            _lut[_i] = 0;
+        else if (_i >= _high)
+            _lut[_i] = 255;
+        else
+            _lut[_i] = static_cast<BYTE>(((_i - _low) * 255 + (_high - _low) / 2) / (_high - _low));
+    }
+    return _lut;
+}
+
+/// @brief Global histogram equalization in place
+/// @param _per_channel equalize every colour channel on its own, otherwise the luma table is applied to all
+/// channels which keeps the hues closer to the original
+template <class Format>
+void equalize_histogram(const image_view<Format> &_img, bool _per_channel = false)
+{
+    if constexpr (!Format::is_gray)
+    {
+        if (_per_channel)
+        {
+            auto _hist = channel_histograms(_img);
+            lut_plan()
+                .then(equalization_lut(_hist[Format::blue]), 1u << Format::blue)
+                .then(equalization_lut(_hist[Format::green]), 1u << Format::green)
+                .then(equalization_lut(_hist[Format::red]), 1u << Format::red)
+                .apply(_img);
+            return;
+        }
+    }
+    apply_lut(_img, equalization_lut(luminance_histogram(_img)));
+}
+
+/// @brief Linear contrast stretch in place from the luma histogram, see stretch_lut
+template <class Format>
+void contrast_stretch(const image_view<Format> &_img, double _clip_percent = 0.5)
+{
+    apply_lut(_img, stretch_lut(luminance_histogram(_img), _clip_percent));
+}
+
+/// @brief Contrast limited adaptive histogram equalization, in place and per channel (alpha excluded)
+/// The image is cut into a `_tiles_x` x `_tiles_y` grid, every tile gets an equalization table from its own
+/// histogram clipped at `_clip_limit` times the mean bin count, the excess spread over all bins.
+/// A pixel takes its four nearest tile tables and blends the looked up values bilinearly
+template <class Format>
+void clahe(const image_view<Format> &_img, size_t _tiles_x = 8, size_t _tiles_y = 8, double _clip_limit = 4.0)
+{
+    static_assert(sizeof(typename Format::channel) == 1, "lookup tables have 256 entries");
+    constexpr size_t _c = Format::channels;
+    if (_img.empty())
+        return;
+    _tiles_x = std::clamp<size_t>(_tiles_x, 1, _img.width());
+    _tiles_y = std::clamp<size_t>(_tiles_y, 1, _img.height());
+    const size_t _tile_w = (_img.width() + _tiles_x - 1) / _tiles_x;
+    const size_t _tile_h = (_img.height() + _tiles_y - 1) / _tiles_y;
+    _tiles_x = (_img.width() + _tile_w - 1) / _tile_w;
+    _tiles_y = (_img.height() + _tile_h - 1) / _tile_h;
+
+    // tables per tile and channel
+    std::vector<byte_lut> _luts(_tiles_x * _tiles_y * _c);
+    parallel_for(_tiles_x * _tiles_y, [&](size_t _begin, size_t _end)
+                 {
+        for (size_t _t = _begin; _t < _end; _t++)
+        {
+            size_t _x0 = _t % _tiles_x * _tile_w, _y0 = _t / _tiles_x * _tile_h;
+            size_t _x1 = std::min(_x0 + _tile_w, _img.width()), _y1 = std::min(_y0 + _tile_h, _img.height());
+            uint64_t _area = (_x1 - _x0) * (_y1 - _y0);
+            std::array<histogram_bins, _c> _hist{};
+            for (size_t _y = _y0; _y < _y1; _y++)
+            {
+                const BYTE *_px = _img.channels(_y) + _x0 * _c;
+                for (size_t _x = _x0; _x < _x1; _x++, _px += _c)
+                    for (size_t _ch = 0; _ch < _c; _ch++)
+                        _hist[_ch][_px[_ch]]++;
+            }
+            uint64_t _limit = std::max<uint64_t>(1, static_cast<uint64_t>(_clip_limit * _area / 256));
+            for (size_t _ch = 0; _ch < _c; _ch++)
+            {
+                histogram_bins &_bins = _hist[_ch];
+                uint64_t _excess = 0;
+                for (uint64_t &_count : _bins)
+                {
+                    if (_count > _limit)
+                    {
+                        _excess += _count - _limit;
+                        _count = _limit;
+                    }
+                }
+                for (size_t _i = 0; _i < 256; _i++)
+                    _bins[_i] += _excess / 256 + (_i < _excess % 256);
+                byte_lut &_lut = _luts[_t * _c + _ch];
+                uint64_t _cdf = 0;
+                for (size_t _i = 0; _i < 256; _i++)
+                {
+                    _cdf += _bins[_i];
+                    _lut[_i] = static_cast<BYTE>((_cdf * 255 + _area / 2) / _area);
+                }
+            }
+        } }, 1);
+
+    // neighbouring tile centres and 8 bit blend weights along each axis
+    struct axis_blend
+    {
+        uint32_t first, second, weight;
+    };
+    auto _blends = [](size_t _n, size_t _tile, size_t _tiles)
+    {
+        std::vector<axis_blend> _out(_n);
+        for (size_t _i = 0; _i < _n; _i++)
+        {
+            double _pos = (_i + 0.5) / _tile - 0.5;
+            if (_pos <= 0)
+                _out[_i] = {0, 0, 0};
+            else if (_pos >= _tiles - 1)
+                _out[_i] = {uint32_t(_tiles - 1), uint32_t(_tiles - 1), 0};
+            else
+            {
+                uint32_t _first = static_cast<uint32_t>(_pos);
+                _out[_i] = {_first, _first + 1, static_cast<uint32_t>((_pos - _first) * 256 + 0.5)};
+            }
+        }
+        return _out;
+    };
+    std::vector<axis_blend> _bx = _blends(_img.width(), _tile_w, _tiles_x);
+    std::vector<axis_blend> _by = _blends(_img.height(), _tile_h, _tiles_y);
+
+    parallel_for(_img.height(), [&](size_t _begin, size_t _end)
+                 {
+        for (size_t _y = _begin; _y < _end; _y++)
+        {
+            const axis_blend &_v = _by[_y];
+            BYTE *_px = _img.channels(_y);
+            for (size_t _x = 0; _x < _img.width(); _x++, _px += _c)
+            {
+                const axis_blend &_h = _bx[_x];
+                const byte_lut *_tl = &_luts[(_v.first * _tiles_x + _h.first) * _c];
+                const byte_lut *_tr = &_luts[(_v.first * _tiles_x + _h.second) * _c];
+                const byte_lut *_bl = &_luts[(_v.second * _tiles_x + _h.first) * _c];
+                const byte_lut *_br = &_luts[(_v.second * _tiles_x + _h.second) * _c];
+                for (size_t _ch = 0; _ch < _c; _ch++)
+                {
+                    if constexpr (Format::has_alpha)
+                    {
+                        if (_ch == Format::alpha)
+                            continue;
+                    }
+                    BYTE _in = _px[_ch];
+                    uint32_t _top = _tl[_ch][_in] * (256 - _h.weight) + _tr[_ch][_in] * _h.weight;
+                    uint32_t _bottom = _bl[_ch][_in] * (256 - _h.weight) + _br[_ch][_in] * _h.weight;
+                    _px[_ch] = static_cast<BYTE>((_top * (256 - _v.weight) + _bottom * _v.weight + 32768) >> 16);
+                }
+            }
+        } }, 16);
+}
+#pragma endregion
+
+#endif
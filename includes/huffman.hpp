@@ -4,6 +4,7 @@
 #include "utilities.hpp"
 #include "priority_queue.hpp"
 #include "chrono"
+#include <cmath>
 
 class huffman_node
 {
@@ -79,6 +80,321 @@ public:
 
 huffman_node huffman_node::empty = huffman_node();
 
+/// @brief Number of substreams the body of a huffman block is split into
+enum class huffman_streams : BYTE
+{
+    stored = 0, // raw bytes, for blocks huffman coding would only grow
+    single = 1,
+    interleaved = 4 // byte i goes to substream i % 4, letting the decoder run four independent bit chains
+};
+
+#pragma pack(push, 1) // Disable padding
+typedef struct tagHUFFMANBLOCKHEADER
+{
+    BYTE bhLayout;      // huffman_streams the block was written with
+    DWORD bhRawSize;    // bytes the block decodes to
+    DWORD bhPackedSize; // bytes following this header
+    WORD bhTreeSize;    // bytes of serialized tree at the start of the payload
+    DWORD bhJumps[3];   // sizes of substreams 0..2, the last substream runs to the end of the payload
+} HUFFMANBLOCKHEADER;
+#pragma pack(pop) // enable padding
+
+/// In memory huffman coding of self contained blocks, each block carries its own tree
+namespace huffman_block
+{
+    constexpr int table_bits = 11; // codes up to this length are resolved with one table lookup
+
+    struct code
+    {
+        uint64_t bits = 0;
+        BYTE length = 0; // 0 when the symbol doesn't occur in the block
+    };
+
+    /// @brief Builds the huffman tree for a 256 entry frequency table
+    std::shared_ptr<huffman_node> build_tree(const size_t *_freq)
+    {
+        size_t _symbols = 0;
+        for (int _i = 0; _i < 256; _i++)
+            _symbols += _freq[_i] != 0;
+
+        pop::min_pq<huffman_node> _pq(_symbols);
+        for (int _i = 0; _i < 256; _i++)
+        {
+            if (_freq[_i])
+                _pq.insert(huffman_node(_freq[_i], static_cast<unsigned char>(_i)));
+        }
+        while (_pq.get_capacity() > 1)
+        {
+            const huffman_node &smallest = _pq.get_min();
+            _pq.deletemin();
+            const huffman_node &smaller = _pq.get_min();
+            _pq.deletemin();
+            _pq.insert(huffman_node(smallest, smaller));
+        }
+        return std::make_shared<huffman_node>(_pq.get_min());
+    }
+
+    /// @brief Serializes the tree in the same layout as huffman::write_header and fills in the codes
+    void write_tree(bit_writer &_writer, const std::shared_ptr<huffman_node> &_node, code *_codes, uint64_t _bits = 0, BYTE _depth = 0)
+    {
+        if (_node->is_leaf)
+        {
+            _writer.put_bits(1, 1);
+            _writer.put_bits(_node->byte_data, 8);
+            // a block made of a single symbol still spends one bit per byte
+            _codes[_node->byte_data] = {_bits, std::max<BYTE>(_depth, 1)};
+        }
+        else
+        {
+            _writer.put_bits(0, 1);
+            write_tree(_writer, _node->left, _codes, _bits << 1, _depth + 1);
+            write_tree(_writer, _node->right, _codes, (_bits << 1) | 1, _depth + 1);
+        }
+    }
+
+    /// @brief Reads a tree written by write_tree straight into codes
+    /// @return false if the tree is malformed
+    bool read_tree(window_bit_reader &_reader, code *_codes, uint64_t _bits = 0, BYTE _depth = 0)
+    {
+        if (_depth > 56 || _reader.overrun())
+            return false;
+        if (_reader.get_bits(1))
+        {
+            BYTE _symbol = static_cast<BYTE>(_reader.get_bits(8));
+            _codes[_symbol] = {_bits, std::max<BYTE>(_depth, 1)};
+            return true;
+        }
+        return read_tree(_reader, _codes, _bits << 1, _depth + 1) &&
+               read_tree(_reader, _codes, (_bits << 1) | 1, _depth + 1);
+    }
+
+    /// @brief Resolves a symbol with one lookup of the next table_bits bits, longer codes fall back to a short scan
+    class table_decoder
+    {
+        struct entry
+        {
+            BYTE symbol;
+            BYTE length; // 0 means the code is longer than table_bits
+        };
+        entry m_table[1 << table_bits] = {};
+        std::vector<std::pair<code, BYTE>> m_long_codes; // shortest first
+
+    public:
+        table_decoder(const code *_codes)
+        {
+            for (int _s = 0; _s < 256; _s++)
+            {
+                const code &_c = _codes[_s];
+                if (_c.length == 0)
+                    continue;
+                if (_c.length <= table_bits)
+                {
+                    size_t _first = _c.bits << (table_bits - _c.length);
+                    size_t _count = size_t(1) << (table_bits - _c.length);
+                    for (size_t _i = 0; _i < _count; _i++)
+                        m_table[_first + _i] = {static_cast<BYTE>(_s), _c.length};
+                }
+                else
+                {
+                    m_long_codes.push_back({_c, static_cast<BYTE>(_s)});
+                }
+            }
+            std::sort(m_long_codes.begin(), m_long_codes.end(), [](const auto &_a, const auto &_b)
+                      { return _a.first.length < _b.first.length; });
+        }
+
+        BYTE next(window_bit_reader &_reader) const
+        {
+            _reader.refill();
+            const entry &_e = m_table[_reader.peek(table_bits)];
+            if (_e.length)
+            {
+                _reader.consume(_e.length);
+                return _e.symbol;
+            }
+            for (const auto &[_c, _symbol] : m_long_codes)
+            {
+                if (_reader.peek(_c.length) == _c.bits)
+                {
+                    _reader.consume(_c.length);
+                    return _symbol;
+                }
+            }
+            // not a valid code, skip a bit so a corrupt stream still terminates
+            _reader.consume(1);
+            return 0;
+        }
+    };
+
+    /// @brief Shannon bound on the size of a coded block with this frequency table, header and tree included
+    /// huffman codes never beat it, so a block whose bound isn't below its raw size won't shrink
+    size_t estimate_size(const size_t *_freq, size_t _size)
+    {
+        double _bits = 0.0;
+        size_t _symbols = 0;
+        for (int _i = 0; _i < 256; _i++)
+        {
+            if (_freq[_i] == 0)
+                continue;
+            _bits += _freq[_i] * std::log2(static_cast<double>(_size) / _freq[_i]);
+            _symbols++;
+        }
+        // the tree spends 9 bits per leaf and 1 bit per internal node
+        size_t _tree_bytes = (_symbols * 10 + 7) / 8;
+        return sizeof(HUFFMANBLOCKHEADER) + _tree_bytes + static_cast<size_t>(std::ceil(_bits / 8.0));
+    }
+
+    /// @brief Appends `_data` to `_out` as a stored block
+    void store(const BYTE *_data, size_t _size, tracked_vector<char> &_out)
+    {
+        HUFFMANBLOCKHEADER _bh{};
+        _bh.bhLayout = static_cast<BYTE>(huffman_streams::stored);
+        _bh.bhRawSize = static_cast<DWORD>(_size);
+        _bh.bhPackedSize = static_cast<DWORD>(_size);
+        const char *_header = reinterpret_cast<const char *>(&_bh);
+        _out.insert(_out.end(), _header, _header + sizeof(HUFFMANBLOCKHEADER));
+        _out.insert(_out.end(), reinterpret_cast<const char *>(_data), reinterpret_cast<const char *>(_data) + _size);
+    }
+
+    /// @brief Appends a block holding `_size` bytes of `_data` to `_out`
+    /// @param _streams interleaved splits the body into 4 substreams that are decoded side by side,
+    /// blocks that wouldn't shrink are stored raw whatever the layout asked for
+    void encode(const BYTE *_data, size_t _size, tracked_vector<char> &_out, huffman_streams _streams = huffman_streams::interleaved)
+    {
+        size_t _freq[256] = {};
+        for (size_t _i = 0; _i < _size; _i++)
+            _freq[_data[_i]]++;
+
+        if (_streams == huffman_streams::stored || estimate_size(_freq, _size) >= _size + sizeof(HUFFMANBLOCKHEADER))
+        {
+            store(_data, _size, _out);
+            return;
+        }
+
+        HUFFMANBLOCKHEADER _bh{};
+        _bh.bhLayout = static_cast<BYTE>(_streams);
+        _bh.bhRawSize = static_cast<DWORD>(_size);
+
+        size_t _header_pos = _out.size();
+        _out.reserve(_header_pos + sizeof(HUFFMANBLOCKHEADER) + _size + 512);
+        _out.resize(_header_pos + sizeof(HUFFMANBLOCKHEADER));
+        size_t _payload_pos = _out.size();
+
+        code _codes[256] = {};
+        if (_size > 0)
+        {
+            bit_writer _tree_writer(_out);
+            write_tree(_tree_writer, build_tree(_freq), _codes);
+            _tree_writer.flush();
+        }
+        _bh.bhTreeSize = static_cast<WORD>(_out.size() - _payload_pos);
+
+        size_t _stream_count = static_cast<size_t>(_streams);
+        for (size_t _s = 0; _s < _stream_count; _s++)
+        {
+            size_t _stream_start = _out.size();
+            bit_writer _writer(_out);
+            for (size_t _i = _s; _i < _size; _i += _stream_count)
+            {
+                const code &_c = _codes[_data[_i]];
+                _writer.put_bits(_c.bits, _c.length);
+            }
+            _writer.flush();
+            if (_s + 1 < _stream_count)
+                _bh.bhJumps[_s] = static_cast<DWORD>(_out.size() - _stream_start);
+        }
+
+        _bh.bhPackedSize = static_cast<DWORD>(_out.size() - _payload_pos);
+        if (_bh.bhPackedSize >= _size)
+        {
+            // the bound was close and the code lengths rounded up past it
+            _out.resize(_header_pos);
+            store(_data, _size, _out);
+            return;
+        }
+        std::memcpy(_out.data() + _header_pos, &_bh, sizeof(HUFFMANBLOCKHEADER));
+    }
+
+    /// @brief Reads and sanity checks the header of the block at `_in`
+    bool read_header(const char *_in, size_t _in_size, HUFFMANBLOCKHEADER &_bh)
+    {
+        if (_in_size < sizeof(HUFFMANBLOCKHEADER))
+            return false;
+        std::memcpy(&_bh, _in, sizeof(HUFFMANBLOCKHEADER));
+        if (_bh.bhLayout != static_cast<BYTE>(huffman_streams::stored) &&
+            _bh.bhLayout != static_cast<BYTE>(huffman_streams::single) &&
+            _bh.bhLayout != static_cast<BYTE>(huffman_streams::interleaved))
+            return false;
+        if (_bh.bhLayout == static_cast<BYTE>(huffman_streams::stored) && _bh.bhPackedSize != _bh.bhRawSize)
+            return false;
+        return _bh.bhPackedSize <= _in_size - sizeof(HUFFMANBLOCKHEADER) && _bh.bhTreeSize <= _bh.bhPackedSize;
+    }
+
+    /// @brief Decodes the block at `_in` into `_out`
+    /// @return bytes of `_in` occupied by the block, 0 if it is malformed or doesn't fit in `_out_capacity`
+    size_t decode(const char *_in, size_t _in_size, BYTE *_out, size_t _out_capacity)
+    {
+        HUFFMANBLOCKHEADER _bh;
+        if (!read_header(_in, _in_size, _bh) || _bh.bhRawSize > _out_capacity)
+            return 0;
+        size_t _block_size = sizeof(HUFFMANBLOCKHEADER) + _bh.bhPackedSize;
+        if (_bh.bhRawSize == 0)
+            return _block_size;
+
+        const char *_payload = _in + sizeof(HUFFMANBLOCKHEADER);
+        if (_bh.bhLayout == static_cast<BYTE>(huffman_streams::stored))
+        {
+            std::memcpy(_out, _payload, _bh.bhRawSize);
+            return _block_size;
+        }
+        code _codes[256] = {};
+        window_bit_reader _tree_reader(_payload, _bh.bhTreeSize);
+        if (!read_tree(_tree_reader, _codes) || _tree_reader.overrun())
+            return 0;
+        table_decoder _table(_codes);
+
+        const char *_body = _payload + _bh.bhTreeSize;
+        size_t _body_size = _bh.bhPackedSize - _bh.bhTreeSize;
+
+        if (_bh.bhLayout == static_cast<BYTE>(huffman_streams::single))
+        {
+            window_bit_reader _reader(_body, _body_size);
+            for (size_t _i = 0; _i < _bh.bhRawSize; _i++)
+                _out[_i] = _table.next(_reader);
+            return _reader.overrun() ? 0 : _block_size;
+        }
+
+        size_t _jumped = size_t(_bh.bhJumps[0]) + _bh.bhJumps[1] + _bh.bhJumps[2];
+        if (_jumped > _body_size)
+            return 0;
+        const char *_s1 = _body + _bh.bhJumps[0];
+        const char *_s2 = _s1 + _bh.bhJumps[1];
+        const char *_s3 = _s2 + _bh.bhJumps[2];
+        window_bit_reader _r0(_body, _bh.bhJumps[0]);
+        window_bit_reader _r1(_s1, _bh.bhJumps[1]);
+        window_bit_reader _r2(_s2, _bh.bhJumps[2]);
+        window_bit_reader _r3(_s3, _body_size - _jumped);
+
+        // the four chains don't depend on each other, so their lookups overlap in the pipeline
+        size_t _quads = _bh.bhRawSize / 4;
+        BYTE *_dst = _out;
+        for (size_t _q = 0; _q < _quads; _q++, _dst += 4)
+        {
+            _dst[0] = _table.next(_r0);
+            _dst[1] = _table.next(_r1);
+            _dst[2] = _table.next(_r2);
+            _dst[3] = _table.next(_r3);
+        }
+        window_bit_reader *_tail[] = {&_r0, &_r1, &_r2};
+        for (size_t _s = 0; _s < _bh.bhRawSize % 4; _s++)
+            _dst[_s] = _table.next(*_tail[_s]);
+
+        if (_r0.overrun() || _r1.overrun() || _r2.overrun() || _r3.overrun())
+            return 0;
+        return _block_size;
+    }
+}; // namespace huffman_block
+
 class huffman
 {
 private:
@@ -98,17 +414,21 @@ private:
     std::string m_tmp_file_name; // temporary file to store huffman header before writing it
 
     char m_eof_bits{'\0'};
+    huffman_streams m_streams; // single writes the classic one tree format, stored and interleaved the blocked one
 
 public:
     /// @param m_in_file_name File to read data from
     /// @param m_out_file_name File to write data to
-    /// @param buf_size chunk size of reading from file
-    huffman(std::string m_in_file_name, std::string m_out_file_name, size_t buf_size = 1 << 16) : m_buf_size(buf_size), m_in_file_name(m_in_file_name), m_out_file_name(m_out_file_name), m_tmp_file_name("tmp_hufman.hufman") {}
+    /// @param buf_size chunk size of reading from file, also the block size of the blocked format
+    /// @param streams interleaved writes blocks of buf_size bytes, each split into 4 substreams with stored jump offsets
+    huffman(std::string m_in_file_name, std::string m_out_file_name, size_t buf_size = 1 << 16, huffman_streams streams = huffman_streams::single) : m_buf_size(buf_size), m_in_file_name(m_in_file_name), m_out_file_name(m_out_file_name), m_tmp_file_name("tmp_hufman.hufman"), m_streams(streams) {}
 
     /// @brief encodes the data from the input file, NOTE: It doesn't output to ooutput file, call write to file for that
     /// @param data_size maximum data to read from in_file(NOTE: Writing with limited data is a future aspect)
     void encode(size_t data_size = INT32_MAX)
     {
+        if (m_streams != huffman_streams::single)
+            return; // every block carries its own tree, built in write_to_file
         m_in_file.open(m_in_file_name, std::ios_base::binary);
         if (!m_in_file.is_open())
         {
@@ -116,33 +436,26 @@ public:
             return;
         }
 
-        char *_buffer = new char[m_buf_size];
-        if (_buffer == nullptr)
-        {
-            std::cerr << "Unable to allocate memory ";
-            return;
-        }
-
         size_t _total_read = 0;
 
         // Timer
         auto _start = std::chrono::high_resolution_clock::now();
 
-        while (_total_read < data_size && !m_in_file.eof())
         {
-            m_in_file.read(_buffer, m_buf_size);
-            std::streamsize bytes_read = m_in_file.gcount(); // Get the actual number of bytes read
-
-            if (bytes_read <= 0)
-                break;
-
-            for (std::streamsize j = 0; j < bytes_read; ++j)
+            // the next chunk is read while this one is counted
+            read_ahead_reader _reader(m_in_file, m_buf_size);
+            const char *_buffer;
+            size_t bytes_read;
+            while (_total_read < data_size && (bytes_read = _reader.next(_buffer)) != 0)
             {
-                m_freq_table[static_cast<unsigned char>(_buffer[j])]++;
-            }
+                for (size_t j = 0; j < bytes_read; ++j)
+                {
+                    m_freq_table[static_cast<unsigned char>(_buffer[j])]++;
+                }
 
-            _total_read += bytes_read;
-            // std::cout << "Reached total_read val " << total_read << std::endl;
+                _total_read += bytes_read;
+                // std::cout << "Reached total_read val " << total_read << std::endl;
+            }
         }
 
         // Timer
@@ -151,8 +464,6 @@ public:
         std::clog << "Time to generate Frequency table : " << _dur.count() << std::endl;
 
         m_in_file.close();
-        delete[] _buffer;
-        _buffer = nullptr;
         // std::cout<<"reached eof "<<m_in_file.eof()<<std::endl;
         // std::cout << "Final total_read val " << total_read <<" in data_size "<<data_size << std::endl;
         // show_freq();
@@ -179,6 +490,12 @@ public:
             std::cerr << "Output file is not open" << std::endl;
             return;
         }
+        if (m_streams != huffman_streams::single || !worth_coding())
+        {
+            write_blocks();
+            m_out_file.close();
+            return;
+        }
 
         // Write header to temporary file
         std::ofstream _tmp_file(m_tmp_file_name, std::ios_base::binary);
@@ -221,7 +538,7 @@ public:
         }
 
         // Read the entire content of the temporary file into a buffer
-        std::vector<char> _buffer((std::istreambuf_iterator<char>(_tmp_file_in)), std::istreambuf_iterator<char>());
+        tracked_vector<char> _buffer((std::istreambuf_iterator<char>(_tmp_file_in)), std::istreambuf_iterator<char>());
         _tmp_file_in.close();
 
         // Write the buffer to the output file
@@ -298,6 +615,20 @@ public:
             std::cerr << "Error reading header size" << std::endl;
             return;
         }
+        if (_header_size == 0)
+        {
+            // blocked format, see write_blocks
+            decode_blocks();
+
+            // Timer
+            auto _end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> _dur = _end - _start;
+            std::clog << "Time taken to Decode is : " << _dur.count() << std::endl;
+
+            m_in_file.close();
+            m_out_file.close();
+            return;
+        }
 
         // sub 1 for eof bytes
         _header_size -= 1;
@@ -321,19 +652,17 @@ public:
         _header = nullptr;
         m_in_file.read(&m_eof_bits, sizeof(m_eof_bits));
         // std::cout << "eof bits are " << int(m_eof_bits);
-        char *_buffer = new char[m_buf_size];
         unsigned char _dat = '\0';
         m_in_file.clear();
 
         std::string _cur_input = "";
-        while (!m_in_file.eof())
+        read_ahead_reader _body(m_in_file, m_buf_size);
+        const char *_buffer;
+        size_t _bytes_read;
+        while ((_bytes_read = _body.next(_buffer)) != 0)
         {
-            m_in_file.read(_buffer, m_buf_size);
-            size_t _bytes_read = m_in_file.gcount();
-            if (_bytes_read == 0)
-                break;
             // std::cout << "Bytes read " << _bytes_read << std::endl;
-            if (m_in_file.eof() == 1)
+            if (_body.at_end())
             {
                 _reader.re_initialize(_buffer, _bytes_read, m_eof_bits);
             }
@@ -359,8 +688,6 @@ public:
         std::chrono::duration<double> _dur = _end - _start;
         std::clog << "Time taken to Decode is : " << _dur.count() << std::endl;
 
-        delete[] _buffer;
-        _buffer = nullptr;
         m_in_file.close();
         m_out_file.close();
     }
@@ -530,16 +857,13 @@ private:
         auto _end = m_in_file.tellg();
         m_in_file.seekg(0, std::ios_base::beg);
         // std::cout<<"end at "<<end;
-        char *_buffer = new char[m_buf_size];
-        while (!m_in_file.eof())
+        read_ahead_reader _reader(m_in_file, m_buf_size);
+        const char *_buffer;
+        size_t bytes_read;
+        while ((bytes_read = _reader.next(_buffer)) != 0)
         {
-            m_in_file.read(_buffer, m_buf_size);
-            std::streamsize bytes_read = m_in_file.gcount();
             // std::cout << "bytes " << bytes_read;
-            if (bytes_read <= 0)
-                break;
-
-            for (std::streamsize j = 0; j < bytes_read; ++j)
+            for (size_t j = 0; j < bytes_read; ++j)
             {
                 unsigned char _c = static_cast<unsigned char>(_buffer[j]);
                 if (!m_encodings.count(_c))
@@ -565,6 +889,93 @@ private:
         m_in_file.close();
     }
 
+    /// @brief checks the frequency table against the code lengths to see if the classic format would shrink the input
+    bool worth_coding()
+    {
+        // a lone symbol gets an empty code, which the classic format can't represent
+        if (m_encodings.size() < 2)
+            return false;
+        size_t _raw_bytes{}, _coded_bits{};
+        for (auto &[_c, _freq] : m_freq_table)
+        {
+            _raw_bytes += _freq;
+            _coded_bits += _freq * m_encodings[_c].size();
+        }
+        // tree header: 9 bits per leaf, 1 per internal node, plus the size and eof fields
+        size_t _coded_bytes = (_coded_bits + 7) / 8 + (m_encodings.size() * 10 + 7) / 8 + sizeof(uint32_t) + 1;
+        if (_coded_bytes < _raw_bytes)
+            return true;
+        std::clog << "Input doesn't compress, writing stored blocks" << std::endl;
+        return false;
+    }
+
+    /// @brief Writes the blocked format: a zero header size, which the classic format never has, followed by
+    /// self contained huffman_block blocks of up to m_buf_size input bytes each
+    void write_blocks()
+    {
+        m_in_file.open(m_in_file_name, std::ios_base::binary);
+        if (!m_in_file.is_open())
+        {
+            std::cerr << "Cant open file for input";
+            return;
+        }
+
+        // Timer
+        auto _start = std::chrono::high_resolution_clock::now();
+
+        uint32_t _marker = 0;
+        m_out_file.write(reinterpret_cast<char *>(&_marker), sizeof(_marker));
+
+        size_t _block_size = std::min<size_t>(m_buf_size, UINT32_MAX);
+        tracked_vector<char> _packed;
+        {
+            // reading the next block and writing the last one both overlap coding this one
+            read_ahead_reader _reader(m_in_file, _block_size);
+            write_behind_writer _writer(m_out_file, _block_size);
+            const char *_buffer;
+            size_t _bytes_read;
+            while ((_bytes_read = _reader.next(_buffer)) != 0)
+            {
+                _packed.clear();
+                huffman_block::encode(reinterpret_cast<const BYTE *>(_buffer), _bytes_read, _packed, m_streams);
+                _writer.write(_packed.data(), _packed.size());
+            }
+        }
+        m_in_file.close();
+
+        // Timer
+        auto _end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> _dur = _end - _start;
+        std::clog << "Time to write to file : " << _dur.count() << std::endl;
+    }
+
+    /// @brief Decodes the blocks following the zero header size written by write_blocks
+    void decode_blocks()
+    {
+        tracked_vector<char> _block;
+        tracked_vector<BYTE> _raw;
+        HUFFMANBLOCKHEADER _bh;
+        read_ahead_reader _reader(m_in_file, m_buf_size);
+        write_behind_writer _writer(m_out_file, m_buf_size);
+        while (_reader.read(reinterpret_cast<char *>(&_bh), sizeof(_bh)) == sizeof(_bh))
+        {
+            _block.resize(sizeof(_bh) + _bh.bhPackedSize);
+            std::memcpy(_block.data(), &_bh, sizeof(_bh));
+            if (_reader.read(_block.data() + sizeof(_bh), _bh.bhPackedSize) != _bh.bhPackedSize)
+            {
+                std::cerr << "Truncated huffman block" << std::endl;
+                return;
+            }
+            _raw.resize(_bh.bhRawSize);
+            if (huffman_block::decode(_block.data(), _block.size(), _raw.data(), _raw.size()) == 0)
+            {
+                std::cerr << "Corrupt huffman block" << std::endl;
+                return;
+            }
+            _writer.write(reinterpret_cast<char *>(_raw.data()), _raw.size());
+        }
+    }
+
     /// @brief prints the tree to the output file
     /// @param _file_to_write file to write to
     /// @param _root root node of huffman tree
@@ -0,0 +1,240 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+#include "utilities.hpp"
+
+#pragma region pixel_formats
+/// Pixel formats an image can be stored in, everything a kernel needs to know is resolved at compile time
+namespace pixel_format
+{
+    struct bgr24
+    {
+        using pixel = RGBTRIPLE;
+        using channel = BYTE;
+        static constexpr size_t channels = 3;
+        static constexpr bool has_alpha = false;
+        static constexpr bool is_gray = false;
+        static constexpr WORD bit_count = 24; // matching biBitCount
+        static constexpr size_t blue = 0, green = 1, red = 2; // channel offsets inside a pixel
+    };
+
+    struct bgra32
+    {
+        using pixel = RGBQUAD;
+        using channel = BYTE;
+        static constexpr size_t channels = 4;
+        static constexpr bool has_alpha = true; // rgbReserved carries the alpha
+        static constexpr bool is_gray = false;
+        static constexpr WORD bit_count = 32;
+        static constexpr size_t blue = 0, green = 1, red = 2, alpha = 3;
+    };
+
+    struct gray8
+    {
+        using pixel = BYTE;
+        using channel = BYTE;
+        static constexpr size_t channels = 1;
+        static constexpr bool has_alpha = false;
+        static constexpr bool is_gray = true;
+        static constexpr WORD bit_count = 8; // with a grayscale palette
+    };
+
+    struct gray16
+    {
+        using pixel = WORD;
+        using channel = WORD;
+        static constexpr size_t channels = 1;
+        static constexpr bool has_alpha = false;
+        static constexpr bool is_gray = true;
+        static constexpr WORD bit_count = 0; // no bmp equivalent, in memory only
+    };
+}; // namespace pixel_format
+#pragma endregion
+
+#pragma region image
+/// @brief Rectangle of pixels, x and y of the top left corner
+struct image_rect
+{
+    size_t x{}, y{}, width{}, height{};
+
+    bool empty() const { return width == 0 || height == 0; }
+    size_t right() const { return x + width; }
+    size_t bottom() const { return y + height; }
+
+    /// @brief grown by `_by` pixels on every side, clipped to a `_width` x `_height` image
+    image_rect expanded(size_t _by, size_t _width, size_t _height) const
+    {
+        size_t _x = x > _by ? x - _by : 0, _y = y > _by ? y - _by : 0;
+        return {_x, _y, std::min(right() + _by, _width) - _x, std::min(bottom() + _by, _height) - _y};
+    }
+
+    image_rect intersected(const image_rect &_other) const
+    {
+        size_t _x = std::max(x, _other.x), _y = std::max(y, _other.y);
+        size_t _r = std::min(right(), _other.right()), _b = std::min(bottom(), _other.bottom());
+        return _r > _x && _b > _y ? image_rect{_x, _y, _r - _x, _b - _y} : image_rect{};
+    }
+};
+
+/// @brief Non owning window on pixel rows, rows are `stride` bytes apart and the stride may be negative
+template <class Format>
+class image_view
+{
+public:
+    using format = Format;
+    using pixel = typename Format::pixel;
+    using channel = typename Format::channel;
+
+private:
+    BYTE *m_data = nullptr; // first pixel of row 0
+    size_t m_width{}, m_height{};
+    ptrdiff_t m_stride{};
+
+public:
+    image_view() = default;
+    image_view(BYTE *data, size_t width, size_t height, ptrdiff_t stride) : m_data(data), m_width(width), m_height(height), m_stride(stride) {}
+
+    pixel *row(size_t _y) const { return reinterpret_cast<pixel *>(m_data + static_cast<ptrdiff_t>(_y) * m_stride); }
+    pixel &at(size_t _x, size_t _y) const { return row(_y)[_x]; }
+    /// @brief row `_y` seen as width * channels channel values
+    channel *channels(size_t _y) const { return reinterpret_cast<channel *>(row(_y)); }
+
+    size_t width() const { return m_width; }
+    size_t height() const { return m_height; }
+    ptrdiff_t stride() const { return m_stride; }
+    BYTE *data() const { return m_data; }
+    bool empty() const { return m_width == 0 || m_height == 0; }
+    /// @brief bytes of pixel data in a row, without the padding up to the stride
+    size_t row_bytes() const { return m_width * sizeof(pixel); }
+
+    /// @brief window on the pixels of `_rect` clipped to this view, sharing the stride so nothing is copied
+    /// operations given a sub view see its edges as the image border
+    image_view sub_view(const image_rect &_rect) const
+    {
+        image_rect _r = _rect.intersected({0, 0, m_width, m_height});
+        if (_r.empty())
+            return image_view(m_data, 0, 0, m_stride);
+        return image_view(reinterpret_cast<BYTE *>(row(_r.y) + _r.x), _r.width, _r.height, m_stride);
+    }
+    image_view sub_view(size_t _x, size_t _y, size_t _width, size_t _height) const { return sub_view({_x, _y, _width, _height}); }
+
+    /// @brief same pixels upside down, only the origin and the sign of the stride change
+    image_view flipped_rows() const
+    {
+        return empty() ? *this : image_view(m_data + static_cast<ptrdiff_t>(m_height - 1) * m_stride, m_width, m_height, -m_stride);
+    }
+};
+
+/// @brief Owning image stored as one contiguous buffer of rows
+/// a bottom up image stores its last row first, like most bitmaps, and hands out views with a negative stride
+/// so row 0 is always the top one
+template <class Format>
+class image
+{
+public:
+    using format = Format;
+    using pixel = typename Format::pixel;
+    using channel = typename Format::channel;
+    static constexpr size_t row_alignment = 16;
+
+private:
+    tracked_vector<BYTE> m_storage;
+    size_t m_width{}, m_height{};
+    ptrdiff_t m_stride{}; // always positive, the distance between stored rows
+    bool m_bottom_up{};
+
+public:
+    image() = default;
+
+    /// @param stride bytes between rows, 0 picks the row size rounded up to row_alignment
+    /// @param bottom_up store the rows bottom to top
+    image(size_t width, size_t height, size_t stride = 0, bool bottom_up = false) : m_width(width), m_height(height), m_bottom_up(bottom_up)
+    {
+        size_t _row_bytes = width * sizeof(pixel);
+        m_stride = static_cast<ptrdiff_t>(stride ? std::max(stride, _row_bytes) : (_row_bytes + row_alignment - 1) / row_alignment * row_alignment);
+        m_storage.resize(static_cast<size_t>(m_stride) * height);
+    }
+
+    image_view<Format> view() { return static_cast<const image &>(*this).view(); }
+    image_view<Format> view() const
+    {
+        image_view<Format> _stored(const_cast<BYTE *>(m_storage.data()), m_width, m_height, m_stride);
+        return m_bottom_up ? _stored.flipped_rows() : _stored;
+    }
+    operator image_view<Format>() { return view(); }
+    operator image_view<Format>() const { return view(); }
+
+    pixel *row(size_t _y) { return view().row(_y); }
+    const pixel *row(size_t _y) const { return view().row(_y); }
+    pixel &at(size_t _x, size_t _y) { return row(_y)[_x]; }
+    const pixel &at(size_t _x, size_t _y) const { return row(_y)[_x]; }
+
+    size_t width() const { return m_width; }
+    size_t height() const { return m_height; }
+    /// @brief stride of the views, negative for bottom up images
+    ptrdiff_t stride() const { return m_bottom_up ? -m_stride : m_stride; }
+    bool bottom_up() const { return m_bottom_up; }
+    /// @brief start of the storage, rows in stored order `m_stride` bytes apart
+    BYTE *data() { return m_storage.data(); }
+    const BYTE *data() const { return m_storage.data(); }
+    bool empty() const { return m_width == 0 || m_height == 0; }
+};
+
+using image_bgr24 = image<pixel_format::bgr24>;
+using image_bgra32 = image<pixel_format::bgra32>;
+using image_gray8 = image<pixel_format::gray8>;
+using image_gray16 = image<pixel_format::gray16>;
+
+/// @brief Image of indices into a colour table, what 4 and 8 bit bitmaps hold
+struct palette_image
+{
+    image_gray8 indices;
+    std::vector<RGBQUAD> palette;
+};
+
+/// @brief Colours of a palette image, the inverse of remap up to the quantization error
+image_bgr24 expand_palette(const palette_image &_img)
+{
+    image_bgr24 _out(_img.indices.width(), _img.indices.height());
+    parallel_for(_out.height(), [&](size_t _begin, size_t _end)
+                 {
+        for (size_t _y = _begin; _y < _end; _y++)
+        {
+            const BYTE *_idx = _img.indices.row(_y);
+            RGBTRIPLE *_px = _out.row(_y);
+            for (size_t _x = 0; _x < _out.width(); _x++)
+            {
+                const RGBQUAD &_q = _idx[_x] < _img.palette.size() ? _img.palette[_idx[_x]] : RGBQUAD{};
+                _px[_x] = {_q.rgbBlue, _q.rgbGreen, _q.rgbRed};
+            }
+        } }, 16);
+    return _out;
+}
+
+/// @brief Copies the pixels of `_src` into `_dst` of the same size row by row
+template <class Format>
+void copy_pixels(const image_view<Format> &_src, const image_view<Format> &_dst)
+{
+    for (size_t _row = 0; _row < std::min(_src.height(), _dst.height()); _row++)
+        std::memcpy(_dst.row(_row), _src.row(_row), std::min(_src.row_bytes(), _dst.row_bytes()));
+}
+
+/// @brief Copies legacy rgb_data rows into a bgr24 image
+image_bgr24 to_image(const rgb_data &_dat)
+{
+    image_bgr24 _img(_dat.empty() ? 0 : _dat[0].size(), _dat.size());
+    for (size_t _row = 0; _row < _img.height(); _row++)
+        std::memcpy(_img.row(_row), _dat[_row].data(), _img.width() * sizeof(RGBTRIPLE));
+    return _img;
+}
+
+/// @brief Copies a bgr24 view back into legacy rgb_data rows
+void to_rgb_data(const image_view<pixel_format::bgr24> &_img, rgb_data &_dat)
+{
+    _dat.assign(_img.height(), std::vector<RGBTRIPLE>(_img.width()));
+    for (size_t _row = 0; _row < _img.height(); _row++)
+        std::memcpy(_dat[_row].data(), _img.row(_row), _img.row_bytes());
+}
+#pragma endregion
+
+#endif
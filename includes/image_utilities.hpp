@@ -4,8 +4,7 @@
 #include "utilities.hpp"
 #include "bmp.hpp"
 #include "math_utils.hpp"
-
-using rgb_data = std::vector<std::vector<RGBTRIPLE>>;
+#include "convolution.hpp"
 
 void rgb_to_grayscale(std::shared_ptr<rgb_data> &_dat)
 {
@@ -71,67 +70,16 @@ namespace edge_Kernels
     static edge_kernel SobelFredmanKernel = {{{1, 0, -1}, {2, 0, -2}, {1, 0, -1}}, {{1, 2, 1}, {0, 0, 0}, {-1, -2, -1}}};
     static edge_kernel PrewittKernel = {{{1, 0, -1}, {1, 0, -1}, {1, 0, -1}}, {{1, 1, 1}, {0, 0, 0}, {-1, -1, -1}}};
 };
+/// @brief Per channel gradient magnitude of the two kernels, runs on the convolution engine
 void edge_detection(std::shared_ptr<rgb_data> &_dat, const edge_Kernels::edge_kernel &_kernel = edge_Kernels::SobelFredmanKernel)
 {
-    size_t _height = _dat->size();
-    size_t _width = _dat->at(0).size();
-
-    // TODO: see the time between copying kernels and directly accessing them , for smaller images it is not a problem , might be a bit different at high res, or just leave it to user
-    std::vector<std::vector<int>> _xmat = _kernel._kernelx;
-    std::vector<std::vector<int>> _ymat = _kernel._kernely;
-
-    rgb_data temp(_height, std::vector<RGBTRIPLE>(_width));
-
-    for (int _row = 0; _row < _height; _row++)
-    {
-        for (int _col = 0; _col < _width; _col++)
-        {
-            int gx_blue = 0, gx_red = 0, gx_green = 0;
-            int gy_blue = 0, gy_red = 0, gy_green = 0;
-
-            for (int _r = -1; _r <= 1; _r++)
-            {
-                for (int _c = -1; _c <= 1; _c++)
-                {
-                    int _row_offset = _row + _r;
-                    int _col_offset = _col + _c;
-
-                    if (_row_offset >= 0 && _col_offset >= 0 && _row_offset < _height && _col_offset < _width)
-                    {
-                        gx_blue += _xmat[_r + 1][_c + 1] * (*_dat)[_row_offset][_col_offset].rgbtBlue;
-                        gx_red += _xmat[_r + 1][_c + 1] * (*_dat)[_row_offset][_col_offset].rgbtRed;
-                        gx_green += _xmat[_r + 1][_c + 1] * (*_dat)[_row_offset][_col_offset].rgbtGreen;
-
-                        gy_blue += _ymat[_r + 1][_c + 1] * (*_dat)[_row_offset][_col_offset].rgbtBlue;
-                        gy_red += _ymat[_r + 1][_c + 1] * (*_dat)[_row_offset][_col_offset].rgbtRed;
-                        gy_green += _ymat[_r + 1][_c + 1] * (*_dat)[_row_offset][_col_offset].rgbtGreen;
-                    }
-                }
-            }
-
-            // Calculate the magnitude of the gradient and clamp to [0, 255]
-            int blue_magnitude = std::min(static_cast<int>(std::sqrt(gx_blue * gx_blue + gy_blue * gy_blue)), 255);
-            int red_magnitude = std::min(static_cast<int>(std::sqrt(gx_red * gx_red + gy_red * gy_red)), 255);
-            int green_magnitude = std::min(static_cast<int>(std::sqrt(gx_green * gx_green + gy_green * gy_green)), 255);
-
-            // std::cout<<blue_magnitude<<" "<<red_magnitude<<" "<<green_magnitude<<" ";
-            // Store the result in the temporary vector
-            temp[_row][_col].rgbtBlue = blue_magnitude;
-            temp[_row][_col].rgbtRed = red_magnitude;
-            temp[_row][_col].rgbtGreen = green_magnitude;
-        }
-    }
-
-    // Copy the results from the temporary vector to _dat
-    for (int _i = 0; _i < _height; _i++)
-    {
-        for (int _j = 0; _j < _width; _j++)
-        {
-            (*_dat)[_i][_j].rgbtBlue = temp[_i][_j].rgbtBlue;
-            (*_dat)[_i][_j].rgbtRed = temp[_i][_j].rgbtRed;
-            (*_dat)[_i][_j].rgbtGreen = temp[_i][_j].rgbtGreen;
-        }
-    }
+    convolution_kernel _kx = convolution_kernel::from_matrix(_kernel._kernelx), _ky = convolution_kernel::from_matrix(_kernel._kernely);
+    if (_kx.size() == 0 || _kx.size() != _ky.size() || _dat->empty())
+        return;
+    image_bgr24 _src = to_image(*_dat);
+    image_bgr24 _dst(_src.width(), _src.height());
+    gradient_magnitude(_src.view(), _dst.view(), _kx, _ky);
+    to_rgb_data(_dst.view(), *_dat);
 }
 
 void invert_colours(std::shared_ptr<rgb_data> &_dat)
@@ -150,47 +98,103 @@ void invert_colours(std::shared_ptr<rgb_data> &_dat)
     }
 }
 
+/// @brief Blurs with a matrix from Gaussian::GaussianMatrix, dividing by its sum, runs on the convolution engine
+/// an even sized matrix is centred like GaussianMatrix centres it, weight i at offset i - n / 2, and padded with a
+/// zero row and column to the odd size the engine needs. A matrix the engine still rejects leaves `_dat` unchanged
 void gaussian_Blur(std::shared_ptr<rgb_data> &_dat, std::pair<size_t, smart_2d_ptr_int> _gaussian_mat)
 {
-    size_t _height = _dat->size();
-    size_t _width = _dat->at(0).size();
-
-    rgb_data temp(_height, std::vector<RGBTRIPLE>(_width));
-
-    int kernel_size = _gaussian_mat.second->size();
-    int half_size = kernel_size / 2;
+    vec_2d _matrix = *_gaussian_mat.second;
+    if (_matrix.size() % 2 == 0 && !_matrix.empty())
+    {
+        for (auto &_row : _matrix)
+            _row.push_back(0);
+        _matrix.emplace_back(_matrix.size() + 1, 0);
+    }
+    convolution_kernel _kernel = convolution_kernel::from_matrix(_matrix, static_cast<int>(_gaussian_mat.first));
+    if (_kernel.size() == 0 || _dat->empty())
+        return;
+    image_bgr24 _src = to_image(*_dat);
+    image_bgr24 _dst(_src.width(), _src.height());
+    convolve(_src.view(), _dst.view(), _kernel);
+    to_rgb_data(_dst.view(), *_dat);
+}
 
-    for (int _row = 0; _row < _height; _row++)
+/// @brief Inverts every colour channel of the view, alpha is left alone
+template <class Format>
+void invert_colours(const image_view<Format> &_img)
+{
+    using channel = typename Format::channel;
+    for (size_t _row = 0; _row < _img.height(); _row++)
     {
-        for (int _col = 0; _col < _width; _col++)
+        if constexpr (std::is_same_v<Format, pixel_format::bgra32>)
         {
-            int _gauss_r = 0, _gauss_g = 0, _gauss_b = 0;
-
-            for (int _r = -half_size; _r <= half_size; _r++)
+            // one xor per pixel flips blue, green and red together
+            BYTE *_px = _img.data() + static_cast<ptrdiff_t>(_row) * _img.stride();
+            for (size_t _col = 0; _col < _img.width(); _col++, _px += sizeof(RGBQUAD))
             {
-                for (int _c = -half_size; _c <= half_size; _c++)
-                {
-                    int _row_offset = _row + _r;
-                    int _col_offset = _col + _c;
-
-                    if (_row_offset >= 0 && _col_offset >= 0 && _row_offset < _height && _col_offset < _width)
-                    {
-                        int _gaussian_value = (*_gaussian_mat.second)[_r + half_size][_c + half_size];
-                        _gauss_r += _gaussian_value * (*_dat)[_row_offset][_col_offset].rgbtRed;
-                        _gauss_g += _gaussian_value * (*_dat)[_row_offset][_col_offset].rgbtGreen;
-                        _gauss_b += _gaussian_value * (*_dat)[_row_offset][_col_offset].rgbtBlue;
-                    }
-                }
+                uint32_t _v;
+                std::memcpy(&_v, _px, sizeof(_v));
+                _v ^= 0x00ffffff;
+                std::memcpy(_px, &_v, sizeof(_v));
             }
+        }
+        else
+        {
+            channel *_c = _img.channels(_row);
+            for (size_t _i = 0; _i < _img.width() * Format::channels; _i++)
+                _c[_i] = std::numeric_limits<channel>::max() - _c[_i];
+        }
+    }
+}
 
-            temp[_row][_col].rgbtRed = static_cast<int>(_gauss_r / _gaussian_mat.first);
-            temp[_row][_col].rgbtGreen = static_cast<int>(_gauss_g / _gaussian_mat.first);
-            temp[_row][_col].rgbtBlue = static_cast<int>(_gauss_b / _gaussian_mat.first);
+/// @brief Sepia tone for the colour formats, same weights as the rgb_data version
+template <class Format>
+void rgb_to_sepia(const image_view<Format> &_img)
+{
+    static_assert(!Format::is_gray, "sepia needs a colour format");
+    for (size_t _row = 0; _row < _img.height(); _row++)
+    {
+        BYTE *_px = _img.channels(_row);
+        for (size_t _col = 0; _col < _img.width(); _col++, _px += Format::channels)
+        {
+            float _r = _px[Format::red], _g = _px[Format::green], _b = _px[Format::blue];
+            _px[Format::red] = static_cast<BYTE>(std::min(_r * .393f + _g * .769f + _b * .189f, 255.0f));
+            _px[Format::green] = static_cast<BYTE>(std::min(_r * .349f + _g * .686f + _b * .168f, 255.0f));
+            _px[Format::blue] = static_cast<BYTE>(std::min(_r * .272f + _g * .534f + _b * .131f, 255.0f));
         }
     }
+}
+
+/// @brief Averages blue, green and red of `_width` pixels into one byte each
+template <class Format>
+void grayscale_row(const BYTE *_px, BYTE *_out, size_t _width)
+{
+    for (size_t _col = 0; _col < _width; _col++, _px += Format::channels)
+    {
+        uint32_t _sum = uint32_t(_px[Format::blue]) + _px[Format::green] + _px[Format::red];
+        // (sum * 21846) >> 16 is sum / 3 for every sum up to 765
+        _out[_col] = static_cast<BYTE>((_sum * 21846) >> 16);
+    }
+}
+
+/// @brief One byte per pixel grayscale of a colour view, same values as the in place rgb_data version
+template <class Format>
+image_gray8 rgb_to_grayscale(const image_view<Format> &_img)
+{
+    static_assert(!Format::is_gray, "image is already grayscale");
+    image_gray8 _gray(_img.width(), _img.height());
+    for (size_t _row = 0; _row < _img.height(); _row++)
+        grayscale_row<Format>(_img.channels(_row), _gray.row(_row), _img.width());
+    return _gray;
+}
 
-    // Copy the results from the temporary vector to _dat
-    *_dat = temp;
+/// @brief One byte per pixel grayscale of legacy rgb_data rows
+image_gray8 rgb_to_grayscale(const rgb_data &_dat)
+{
+    image_gray8 _gray(_dat.empty() ? 0 : _dat[0].size(), _dat.size());
+    for (size_t _row = 0; _row < _gray.height(); _row++)
+        grayscale_row<pixel_format::bgr24>(reinterpret_cast<const BYTE *>(_dat[_row].data()), _gray.row(_row), _gray.width());
+    return _gray;
 }
 
-#endif
\ No newline at end of file
+#endif
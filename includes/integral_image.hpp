@@ -0,0 +1,178 @@
+#ifndef INTEGRAL_IMAGE_HPP
+#define INTEGRAL_IMAGE_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+#include <stdexcept>
+
+#pragma region integral_image
+/// @brief Summed area table of an image, every channel kept separately, answers any rectangle sum in O(1)
+/// sums are 32 bit when the sum of the whole image fits, else 64 bit. Since a rectangle is never larger
+/// than the whole image, unsigned wrap around in the corner differences can't change the result
+class integral_image
+{
+private:
+    size_t m_width{}, m_height{}, m_channels{};
+    bool m_wide{}, m_wide_squares{}, m_has_squares{};
+    tracked_vector<uint32_t> m_sums32, m_squares32;
+    tracked_vector<uint64_t> m_sums64, m_squares64;
+
+    /// @brief row prefix sums in parallel over rows, then column prefix sums in parallel over column bands
+    template <class Acc, class Format>
+    void build(const image_view<Format> &_src, tracked_vector<Acc> &_table, bool _square)
+    {
+        const size_t _row = (m_width + 1) * m_channels;
+        _table.assign(_row * (m_height + 1), 0);
+
+        parallel_for(m_height, [&](size_t _begin, size_t _end)
+                     {
+            for (size_t _y = _begin; _y < _end; _y++)
+            {
+                const auto *_in = _src.channels(_y);
+                Acc *_out = &_table[(_y + 1) * _row + m_channels];
+                for (size_t _c = 0; _c < m_channels; _c++)
+                {
+                    Acc _run = 0;
+                    for (size_t _x = 0; _x < m_width; _x++)
+                    {
+                        Acc _v = _in[_x * m_channels + _c];
+                        _run += _square ? _v * _v : _v;
+                        _out[_x * m_channels + _c] = _run;
+                    }
+                }
+            } }, 32);
+
+        parallel_for(_row, [&](size_t _begin, size_t _end)
+                     {
+            for (size_t _y = 2; _y <= m_height; _y++)
+            {
+                Acc *_cur = &_table[_y * _row];
+                const Acc *_prev = _cur - _row;
+                for (size_t _i = _begin; _i < _end; _i++)
+                    _cur[_i] += _prev[_i];
+            } }, 256);
+    }
+
+    template <class Acc>
+    uint64_t corners(const tracked_vector<Acc> &_table, size_t _x, size_t _y, size_t _w, size_t _h, size_t _c) const
+    {
+        const size_t _row = (m_width + 1) * m_channels;
+        const Acc *_top = &_table[_y * _row + _c];
+        const Acc *_bottom = &_table[(_y + _h) * _row + _c];
+        Acc _sum = _bottom[(_x + _w) * m_channels] - _top[(_x + _w) * m_channels] - _bottom[_x * m_channels] + _top[_x * m_channels];
+        return _sum;
+    }
+
+public:
+    integral_image() = default;
+
+    /// @param with_squares also keep sums of squared values, needed for variance
+    template <class Format>
+    integral_image(const image_view<Format> &src, bool with_squares = false)
+        : m_width(src.width()), m_height(src.height()), m_channels(Format::channels), m_has_squares(with_squares)
+    {
+        constexpr uint64_t _max = std::numeric_limits<typename Format::channel>::max();
+        // the bound is computed in floating point, width * height * max^2 can overflow 64 bits
+        double _pixels = static_cast<double>(m_width) * m_height;
+        m_wide = _pixels * _max > UINT32_MAX;
+        m_wide_squares = _pixels * _max * _max > UINT32_MAX;
+
+        if (m_wide)
+            build(src, m_sums64, false);
+        else
+            build(src, m_sums32, false);
+        if (!with_squares)
+            return;
+        if (m_wide_squares)
+            build(src, m_squares64, true);
+        else
+            build(src, m_squares32, true);
+    }
+
+    /// @brief sum of channel `_c` over the _w x _h rectangle at (_x, _y)
+    uint64_t sum(size_t _x, size_t _y, size_t _w, size_t _h, size_t _c = 0) const
+    {
+        return m_wide ? corners(m_sums64, _x, _y, _w, _h, _c) : corners(m_sums32, _x, _y, _w, _h, _c);
+    }
+
+    /// @brief sum of squared values, only available when built with_squares
+    /// @throws std::logic_error when built without them, there is no table to read
+    uint64_t sum_of_squares(size_t _x, size_t _y, size_t _w, size_t _h, size_t _c = 0) const
+    {
+        if (!m_has_squares)
+            throw std::logic_error("integral_image built without with_squares has no sums of squares");
+        return m_wide_squares ? corners(m_squares64, _x, _y, _w, _h, _c) : corners(m_squares32, _x, _y, _w, _h, _c);
+    }
+
+    double mean(size_t _x, size_t _y, size_t _w, size_t _h, size_t _c = 0) const
+    {
+        return static_cast<double>(sum(_x, _y, _w, _h, _c)) / (_w * _h);
+    }
+
+    /// @throws std::logic_error when built without with_squares
+    double variance(size_t _x, size_t _y, size_t _w, size_t _h, size_t _c = 0) const
+    {
+        double _n = static_cast<double>(_w * _h);
+        double _mean = sum(_x, _y, _w, _h, _c) / _n;
+        return std::max(0.0, sum_of_squares(_x, _y, _w, _h, _c) / _n - _mean * _mean);
+    }
+
+    size_t width() const { return m_width; }
+    size_t height() const { return m_height; }
+    size_t channels() const { return m_channels; }
+    bool wide() const { return m_wide; }
+    bool has_squares() const { return m_has_squares; }
+};
+
+/// @brief Mean filter over a (2 * _radius + 1) square window clipped to the image, constant cost for any radius
+template <class Format>
+void box_blur(const image_view<Format> &_src, const image_view<Format> &_dst, size_t _radius)
+{
+    using channel = typename Format::channel;
+    integral_image _sat(_src);
+    parallel_for(_src.height(), [&](size_t _begin, size_t _end)
+                 {
+        for (size_t _y = _begin; _y < _end; _y++)
+        {
+            size_t _y0 = _y > _radius ? _y - _radius : 0;
+            size_t _y1 = std::min(_y + _radius + 1, _src.height());
+            channel *_out = _dst.channels(_y);
+            for (size_t _x = 0; _x < _src.width(); _x++)
+            {
+                size_t _x0 = _x > _radius ? _x - _radius : 0;
+                size_t _x1 = std::min(_x + _radius + 1, _src.width());
+                uint64_t _area = (_x1 - _x0) * (_y1 - _y0);
+                for (size_t _c = 0; _c < Format::channels; _c++)
+                    _out[_x * Format::channels + _c] = static_cast<channel>((_sat.sum(_x0, _y0, _x1 - _x0, _y1 - _y0, _c) + _area / 2) / _area);
+            }
+        } }, 16);
+}
+
+/// @brief Bradley style adaptive threshold: white where a pixel is above its local mean lowered by `_percent`
+/// @param _radius half size of the window the mean is taken over
+image_gray8 adaptive_threshold(const image_view<pixel_format::gray8> &_src, size_t _radius = 7, double _percent = 15.0)
+{
+    image_gray8 _dst(_src.width(), _src.height());
+    integral_image _sat(_src);
+    const double _scale = 1.0 - _percent / 100.0;
+    parallel_for(_src.height(), [&](size_t _begin, size_t _end)
+                 {
+        for (size_t _y = _begin; _y < _end; _y++)
+        {
+            size_t _y0 = _y > _radius ? _y - _radius : 0;
+            size_t _y1 = std::min(_y + _radius + 1, _src.height());
+            const BYTE *_in = _src.row(_y);
+            BYTE *_out = _dst.row(_y);
+            for (size_t _x = 0; _x < _src.width(); _x++)
+            {
+                size_t _x0 = _x > _radius ? _x - _radius : 0;
+                size_t _x1 = std::min(_x + _radius + 1, _src.width());
+                double _area = static_cast<double>((_x1 - _x0) * (_y1 - _y0));
+                _out[_x] = _in[_x] * _area > _sat.sum(_x0, _y0, _x1 - _x0, _y1 - _y0) * _scale ? 255 : 0;
+            }
+        } }, 16);
+    return _dst;
+}
+#pragma endregion
+
+#endif
@@ -0,0 +1,336 @@
+#ifndef LOSSLESS_CODEC_HPP
+#define LOSSLESS_CODEC_HPP
+
+#include "utilities.hpp"
+#include "huffman.hpp"
+
+#pragma region container
+#pragma pack(push, 1) // Disable padding
+// Layout: header, one row_filter byte per row, then huffman_block blocks holding the residuals,
+// plane after plane when lhPlanar is set
+typedef struct tagLOSSLESSHEADER
+{
+    DWORD lhMagic; // LBMP
+    DWORD lhWidth;
+    DWORD lhHeight;
+    BYTE lhChannels; // 3, bytes per pixel
+    BYTE lhPlanar;   // 1 if every channel is filtered and coded as its own plane
+} LOSSLESSHEADER;
+#pragma pack(pop) // enable padding
+#pragma endregion
+
+#pragma region lossless
+namespace lossless
+{
+    constexpr DWORD magic = 0x504d424c; // LBMP in little endian
+    constexpr size_t block_size = 1 << 20;
+
+    /// @brief per row predictors, same set and meaning as png
+    enum class row_filter : BYTE
+    {
+        none = 0,
+        sub = 1,     // left neighbour
+        up = 2,      // neighbour in the previous row
+        average = 3, // mean of left and up
+        paeth = 4,   // whichever of left, up and up-left is closest to left + up - up-left
+        count = 5
+    };
+
+    BYTE paeth_predictor(BYTE _a, BYTE _b, BYTE _c)
+    {
+        int _p = int(_a) + _b - _c;
+        int _pa = std::abs(_p - _a);
+        int _pb = std::abs(_p - _b);
+        int _pc = std::abs(_p - _c);
+        if (_pa <= _pb && _pa <= _pc)
+            return _a;
+        if (_pb <= _pc)
+            return _b;
+        return _c;
+    }
+
+    /// @brief writes the residuals of `_cur` against the prediction of `_filter`
+    /// @param _prev previous row, all zeros for the first one
+    /// @param _bpp distance in bytes to the left neighbour of the same channel
+    void filter_row(row_filter _filter, const BYTE *_cur, const BYTE *_prev, BYTE *_out, size_t _n, size_t _bpp)
+    {
+        size_t _lead = std::min(_bpp, _n);
+        switch (_filter)
+        {
+        case row_filter::none:
+            std::memcpy(_out, _cur, _n);
+            break;
+        case row_filter::sub:
+            std::memcpy(_out, _cur, _lead);
+            for (size_t _i = _bpp; _i < _n; _i++)
+                _out[_i] = _cur[_i] - _cur[_i - _bpp];
+            break;
+        case row_filter::up:
+            for (size_t _i = 0; _i < _n; _i++)
+                _out[_i] = _cur[_i] - _prev[_i];
+            break;
+        case row_filter::average:
+            for (size_t _i = 0; _i < _lead; _i++)
+                _out[_i] = _cur[_i] - (_prev[_i] >> 1);
+            for (size_t _i = _bpp; _i < _n; _i++)
+                _out[_i] = _cur[_i] - ((_cur[_i - _bpp] + _prev[_i]) >> 1);
+            break;
+        default:
+            for (size_t _i = 0; _i < _lead; _i++)
+                _out[_i] = _cur[_i] - _prev[_i];
+            for (size_t _i = _bpp; _i < _n; _i++)
+                _out[_i] = _cur[_i] - paeth_predictor(_cur[_i - _bpp], _prev[_i], _prev[_i - _bpp]);
+            break;
+        }
+    }
+
+    /// @brief inverse of filter_row, rebuilds `_out` from the residuals in `_res`
+    void unfilter_row(row_filter _filter, const BYTE *_res, const BYTE *_prev, BYTE *_out, size_t _n, size_t _bpp)
+    {
+        size_t _lead = std::min(_bpp, _n);
+        switch (_filter)
+        {
+        case row_filter::none:
+            std::memcpy(_out, _res, _n);
+            break;
+        case row_filter::sub:
+            std::memcpy(_out, _res, _lead);
+            for (size_t _i = _bpp; _i < _n; _i++)
+                _out[_i] = _res[_i] + _out[_i - _bpp];
+            break;
+        case row_filter::up:
+            for (size_t _i = 0; _i < _n; _i++)
+                _out[_i] = _res[_i] + _prev[_i];
+            break;
+        case row_filter::average:
+            for (size_t _i = 0; _i < _lead; _i++)
+                _out[_i] = _res[_i] + (_prev[_i] >> 1);
+            for (size_t _i = _bpp; _i < _n; _i++)
+                _out[_i] = _res[_i] + ((_out[_i - _bpp] + _prev[_i]) >> 1);
+            break;
+        default:
+            for (size_t _i = 0; _i < _lead; _i++)
+                _out[_i] = _res[_i] + _prev[_i];
+            for (size_t _i = _bpp; _i < _n; _i++)
+                _out[_i] = _res[_i] + paeth_predictor(_out[_i - _bpp], _prev[_i], _prev[_i - _bpp]);
+            break;
+        }
+    }
+
+    /// @brief sum of absolute residuals read as signed bytes, the usual png heuristic for picking a filter
+    size_t residual_cost(const BYTE *_res, size_t _n)
+    {
+        size_t _cost{};
+        for (size_t _i = 0; _i < _n; _i++)
+            _cost += _res[_i] < 128 ? _res[_i] : 256 - _res[_i];
+        return _cost;
+    }
+
+    /// @brief Filters and huffman codes `_height` rows of `_width` pixels, appending the container to `_out`
+    /// @param _row_at callable returning a pointer to the first pixel of the given row
+    /// @param _planar code blue, green and red as separate planes, usually smaller for photos
+    template <class RowFn>
+    void compress_rows(size_t _width, size_t _height, RowFn &&_row_at, tracked_vector<char> &_out, bool _planar = true)
+    {
+        LOSSLESSHEADER _lh{};
+        _lh.lhMagic = magic;
+        _lh.lhHeight = static_cast<DWORD>(_height);
+        _lh.lhWidth = static_cast<DWORD>(_width);
+        _lh.lhChannels = sizeof(RGBTRIPLE);
+        _lh.lhPlanar = _planar;
+
+        size_t _planes = _planar ? sizeof(RGBTRIPLE) : 1;
+        size_t _row_bytes = _planar ? _lh.lhWidth : _lh.lhWidth * sizeof(RGBTRIPLE);
+        size_t _bpp = _planar ? 1 : sizeof(RGBTRIPLE);
+        size_t _plane_size = _height * _row_bytes;
+
+        // gather the pixels into planes
+        tracked_vector<BYTE> _src(_planes * _plane_size);
+        for (size_t _row = 0; _row < _height; _row++)
+        {
+            const BYTE *_px = reinterpret_cast<const BYTE *>(_row_at(_row));
+            if (!_planar)
+            {
+                std::memcpy(&_src[_row * _row_bytes], _px, _row_bytes);
+                continue;
+            }
+            for (size_t _col = 0; _col < _row_bytes; _col++)
+            {
+                for (size_t _p = 0; _p < _planes; _p++)
+                    _src[_p * _plane_size + _row * _row_bytes + _col] = _px[_col * sizeof(RGBTRIPLE) + _p];
+            }
+        }
+
+        // pick one filter per row, shared by all planes
+        tracked_vector<BYTE> _res(_src.size());
+        tracked_vector<BYTE> _filters(_height);
+        tracked_vector<BYTE> _zero_row(_row_bytes);
+        tracked_vector<BYTE> _trial(_row_bytes);
+        for (size_t _row = 0; _row < _height; _row++)
+        {
+            size_t _best_cost = SIZE_MAX;
+            for (BYTE _f = 0; _f < static_cast<BYTE>(row_filter::count); _f++)
+            {
+                size_t _cost{};
+                for (size_t _p = 0; _p < _planes; _p++)
+                {
+                    const BYTE *_cur = &_src[_p * _plane_size + _row * _row_bytes];
+                    const BYTE *_prev = _row ? _cur - _row_bytes : _zero_row.data();
+                    filter_row(static_cast<row_filter>(_f), _cur, _prev, _trial.data(), _row_bytes, _bpp);
+                    _cost += residual_cost(_trial.data(), _row_bytes);
+                }
+                if (_cost < _best_cost)
+                {
+                    _best_cost = _cost;
+                    _filters[_row] = _f;
+                }
+            }
+            for (size_t _p = 0; _p < _planes; _p++)
+            {
+                const BYTE *_cur = &_src[_p * _plane_size + _row * _row_bytes];
+                const BYTE *_prev = _row ? _cur - _row_bytes : _zero_row.data();
+                filter_row(static_cast<row_filter>(_filters[_row]), _cur, _prev, &_res[_p * _plane_size + _row * _row_bytes], _row_bytes, _bpp);
+            }
+        }
+
+        const char *_header = reinterpret_cast<const char *>(&_lh);
+        _out.insert(_out.end(), _header, _header + sizeof(LOSSLESSHEADER));
+        _out.insert(_out.end(), _filters.begin(), _filters.end());
+        // blocks never straddle planes so each plane gets its own trees
+        for (size_t _p = 0; _p < _planes; _p++)
+        {
+            for (size_t _off = 0; _off < _plane_size; _off += block_size)
+                huffman_block::encode(&_res[_p * _plane_size + _off], std::min(block_size, _plane_size - _off), _out);
+        }
+    }
+
+    /// @brief Filters and huffman codes the pixels, appending the container to `_out`
+    /// @param _planar code blue, green and red as separate planes, usually smaller for photos
+    void compress(const rgb_data &_dat, tracked_vector<char> &_out, bool _planar = true)
+    {
+        compress_rows(_dat.empty() ? 0 : _dat[0].size(), _dat.size(), [&](size_t _row)
+                      { return _dat[_row].data(); }, _out, _planar);
+    }
+
+    /// @brief Decodes a container written by compress into tightly packed BGR rows
+    /// @return false if the data is not a valid container
+    bool decode_pixels(const char *_in, size_t _size, size_t &_width, size_t &_height, tracked_vector<BYTE> &_pixels)
+    {
+        LOSSLESSHEADER _lh;
+        if (_size < sizeof(LOSSLESSHEADER))
+            return false;
+        std::memcpy(&_lh, _in, sizeof(LOSSLESSHEADER));
+        if (_lh.lhMagic != magic || _lh.lhChannels != sizeof(RGBTRIPLE))
+            return false;
+
+        _width = _lh.lhWidth;
+        _height = _lh.lhHeight;
+        bool _planar = _lh.lhPlanar;
+        size_t _planes = _planar ? sizeof(RGBTRIPLE) : 1;
+        size_t _row_bytes = _planar ? _width : _width * sizeof(RGBTRIPLE);
+        size_t _bpp = _planar ? 1 : sizeof(RGBTRIPLE);
+        size_t _plane_size = _height * _row_bytes;
+
+        size_t _pos = sizeof(LOSSLESSHEADER);
+        if (_size - _pos < _height)
+            return false;
+        const BYTE *_filters = reinterpret_cast<const BYTE *>(_in + _pos);
+        _pos += _height;
+
+        // a coded byte costs at least one bit and a stored one a byte, so a payload can't hold more than 8 bytes
+        // of residuals per byte; checked before anything is allocated from the header's dimensions
+        if (_height != 0 && _width * sizeof(RGBTRIPLE) > SIZE_MAX / _height)
+            return false;
+        if (_width * sizeof(RGBTRIPLE) * _height / 8 > _size - _pos)
+            return false;
+
+        tracked_vector<BYTE> _res(_planes * _plane_size);
+        size_t _filled{};
+        while (_filled < _res.size())
+        {
+            size_t _used = huffman_block::decode(_in + _pos, _size - _pos, &_res[_filled], _res.size() - _filled);
+            HUFFMANBLOCKHEADER _bh;
+            if (_used == 0 || !huffman_block::read_header(_in + _pos, _size - _pos, _bh) || _bh.bhRawSize == 0)
+                return false;
+            _filled += _bh.bhRawSize;
+            _pos += _used;
+        }
+
+        tracked_vector<BYTE> _src(_res.size());
+        tracked_vector<BYTE> _zero_row(_row_bytes);
+        for (size_t _row = 0; _row < _height; _row++)
+        {
+            if (_filters[_row] >= static_cast<BYTE>(row_filter::count))
+                return false;
+            for (size_t _p = 0; _p < _planes; _p++)
+            {
+                size_t _at = _p * _plane_size + _row * _row_bytes;
+                const BYTE *_prev = _row ? &_src[_at - _row_bytes] : _zero_row.data();
+                unfilter_row(static_cast<row_filter>(_filters[_row]), &_res[_at], _prev, &_src[_at], _row_bytes, _bpp);
+            }
+        }
+
+        if (!_planar)
+        {
+            _pixels = std::move(_src);
+            return true;
+        }
+        _pixels.resize(_src.size());
+        for (size_t _i = 0; _i < _plane_size; _i++)
+        {
+            for (size_t _p = 0; _p < _planes; _p++)
+                _pixels[_i * sizeof(RGBTRIPLE) + _p] = _src[_p * _plane_size + _i];
+        }
+        return true;
+    }
+
+    /// @brief Decodes a container written by compress
+    /// @return false if the data is not a valid container
+    bool decompress(const char *_in, size_t _size, rgb_data &_dat)
+    {
+        size_t _width{}, _height{};
+        tracked_vector<BYTE> _pixels;
+        if (!decode_pixels(_in, _size, _width, _height, _pixels))
+            return false;
+        _dat.assign(_height, std::vector<RGBTRIPLE>(_width));
+        for (size_t _row = 0; _row < _height; _row++)
+            std::memcpy(_dat[_row].data(), &_pixels[_row * _width * sizeof(RGBTRIPLE)], _width * sizeof(RGBTRIPLE));
+        return true;
+    }
+
+    /// @brief compresses the pixels into a file
+    bool write_file(const std::string &_file_name, const rgb_data &_dat, bool _planar = true)
+    {
+        std::ofstream _out_file(_file_name, std::ios_base::binary);
+        if (!_out_file.is_open())
+        {
+            std::cerr << "Can't open the output file!";
+            return false;
+        }
+        tracked_vector<char> _packed;
+        compress(_dat, _packed, _planar);
+        _out_file.write(_packed.data(), _packed.size());
+        return _out_file.good();
+    }
+
+    /// @brief reads a file written by write_file
+    bool read_file(const std::string &_file_name, rgb_data &_dat)
+    {
+        std::ifstream _in_file(_file_name, std::ios_base::binary);
+        if (!_in_file.is_open())
+        {
+            std::cerr << "No such file exists";
+            return false;
+        }
+        tracked_vector<char> _packed((std::istreambuf_iterator<char>(_in_file)), std::istreambuf_iterator<char>());
+        if (!decompress(_packed.data(), _packed.size(), _dat))
+        {
+            std::cerr << "Not a lossless container!";
+            return false;
+        }
+        return true;
+    }
+}; // namespace lossless
+#pragma endregion
+
+#endif
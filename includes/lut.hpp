@@ -0,0 +1,158 @@
+#ifndef LUT_HPP
+#define LUT_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+#include <array>
+#include <cmath>
+
+#pragma region lut
+using byte_lut = std::array<BYTE, 256>;
+
+/// Channels a point operation applies to, by offset inside the pixel: blue, green, red, alpha for the colour
+/// formats and the single value of gray8 as channel 0
+enum lut_channels : unsigned
+{
+    lut_channel_0 = 1,
+    lut_channel_1 = 2,
+    lut_channel_2 = 4,
+    lut_channel_3 = 8,
+    lut_colour = lut_channel_0 | lut_channel_1 | lut_channel_2, // everything but alpha
+    lut_all = lut_colour | lut_channel_3
+};
+
+/// @brief Chain of per channel point operations folded into one 256 entry table per channel when the chain is
+/// built, so any number of tonal adjustments costs a single lookup per channel when applied
+/// every step rounds to a byte, which gives the same result as running the steps one after another
+class lut_plan
+{
+private:
+    std::array<byte_lut, 4> m_tables;
+
+    static BYTE to_byte(double _v) { return static_cast<BYTE>(std::clamp(std::lround(_v), 0l, 255l)); }
+
+public:
+    lut_plan()
+    {
+        for (byte_lut &_table : m_tables)
+            for (size_t _i = 0; _i < 256; _i++)
+                _table[_i] = static_cast<BYTE>(_i);
+    }
+
+    /// @brief follows the chain with `_lut` on the chosen channels
+    lut_plan &then(const byte_lut &_lut, unsigned _channels = lut_colour)
+    {
+        for (size_t _ch = 0; _ch < 4; _ch++)
+        {
+            if (_channels & (1u << _ch))
+                for (BYTE &_v : m_tables[_ch])
+                    _v = _lut[_v];
+        }
+        return *this;
+    }
+
+    /// @brief follows the chain with any mapping of 0..255, the result is rounded and clamped to a byte
+    template <class Fn>
+    lut_plan &map(Fn &&_fn, unsigned _channels = lut_colour)
+    {
+        byte_lut _lut;
+        for (size_t _i = 0; _i < 256; _i++)
+            _lut[_i] = to_byte(_fn(static_cast<double>(_i)));
+        return then(_lut, _channels);
+    }
+
+    lut_plan &invert(unsigned _channels = lut_colour)
+    {
+        return map([](double _v)
+                   { return 255.0 - _v; }, _channels);
+    }
+
+    /// @brief out = 255 * (in / 255) ^ (1 / _gamma), above 1 brightens
+    lut_plan &gamma(double _gamma, unsigned _channels = lut_colour)
+    {
+        return map([=](double _v)
+                   { return 255.0 * std::pow(_v / 255.0, 1.0 / _gamma); }, _channels);
+    }
+
+    /// @brief photo editor style levels: [_in_black, _in_white] is stretched to [_out_black, _out_white]
+    /// with a midtone `_gamma` in between, values outside the input range are clipped
+    lut_plan &levels(BYTE _in_black, BYTE _in_white, double _gamma = 1.0, BYTE _out_black = 0, BYTE _out_white = 255, unsigned _channels = lut_colour)
+    {
+        double _span = std::max(1, _in_white - _in_black);
+        return map([=](double _v)
+                   {
+            double _t = std::clamp((_v - _in_black) / _span, 0.0, 1.0);
+            return _out_black + (_out_white - _out_black) * std::pow(_t, 1.0 / _gamma); }, _channels);
+    }
+
+    /// @brief piecewise linear curve through (input, output) points, flat before the first and after the last
+    lut_plan &curve(std::vector<std::pair<BYTE, BYTE>> _points, unsigned _channels = lut_colour)
+    {
+        if (_points.empty())
+            return *this;
+        std::sort(_points.begin(), _points.end());
+        return map([&](double _v)
+                   {
+            if (_v <= _points.front().first)
+                return static_cast<double>(_points.front().second);
+            for (size_t _i = 1; _i < _points.size(); _i++)
+            {
+                const auto &_a = _points[_i - 1], &_b = _points[_i];
+                if (_v <= _b.first)
+                    return _a.second + (static_cast<double>(_b.second) - _a.second) * (_v - _a.first) / std::max(1, _b.first - _a.first);
+            }
+            return static_cast<double>(_points.back().second); }, _channels);
+    }
+
+    const byte_lut &table(size_t _ch) const { return m_tables[_ch]; }
+
+    /// @brief Maps `_img` through the tables in place, rows in parallel
+    /// the lookups of a pixel don't depend on each other, so they are issued together with no branch on the
+    /// channel; gray rows are unrolled four pixels at a time
+    template <class Format>
+    void apply(const image_view<Format> &_img) const
+    {
+        static_assert(sizeof(typename Format::channel) == 1, "lookup tables have 256 entries");
+        constexpr size_t _c = Format::channels;
+        const byte_lut &_t0 = m_tables[0], &_t1 = m_tables[1], &_t2 = m_tables[2], &_t3 = m_tables[3];
+        parallel_for(_img.height(), [&](size_t _begin, size_t _end)
+                     {
+            for (size_t _y = _begin; _y < _end; _y++)
+            {
+                BYTE *_px = _img.channels(_y);
+                size_t _x = 0;
+                if constexpr (_c == 1)
+                {
+                    for (; _x + 4 <= _img.width(); _x += 4, _px += 4)
+                    {
+                        BYTE _a = _t0[_px[0]], _b = _t0[_px[1]], _d = _t0[_px[2]], _e = _t0[_px[3]];
+                        _px[0] = _a;
+                        _px[1] = _b;
+                        _px[2] = _d;
+                        _px[3] = _e;
+                    }
+                }
+                for (; _x < _img.width(); _x++, _px += _c)
+                {
+                    _px[0] = _t0[_px[0]];
+                    if constexpr (_c >= 3)
+                    {
+                        _px[1] = _t1[_px[1]];
+                        _px[2] = _t2[_px[2]];
+                    }
+                    if constexpr (_c == 4)
+                        _px[3] = _t3[_px[3]];
+                }
+            } }, 32);
+    }
+};
+
+/// @brief Maps every colour channel through `_lut` in place, alpha is left alone
+template <class Format>
+void apply_lut(const image_view<Format> &_img, const byte_lut &_lut)
+{
+    lut_plan().then(_lut).apply(_img);
+}
+#pragma endregion
+
+#endif
@@ -41,6 +41,34 @@ namespace Gaussian
 
         return std::make_pair(static_cast<size_t>(_sum), _mat);
     }
+
+    /// @brief Generates a 1d gaussian kernel in fixed point, one axis of the separable GaussianMatrix
+    /// @param _n number of taps, odd
+    /// @param _std the standard deviation of the function
+    /// @param _bits the weights sum to exactly 1 << _bits, so normalizing is a shift
+    std::vector<int> GaussianKernel1D(int _n, float _std = 1.0f, int _bits = 8)
+    {
+        std::vector<double> _values(_n);
+        double _sum = 0.0;
+        int _half_n = _n / 2;
+        for (int i = 0; i < _n; i++)
+        {
+            int x = i - _half_n;
+            _values[i] = exp(-(x * x) / (2.0 * _std * _std));
+            _sum += _values[i];
+        }
+
+        std::vector<int> _kernel(_n);
+        int _total = 0;
+        for (int i = 0; i < _n; i++)
+        {
+            _kernel[i] = static_cast<int>(std::lround(_values[i] / _sum * (1 << _bits)));
+            _total += _kernel[i];
+        }
+        // rounding leftovers go to the centre tap
+        _kernel[_half_n] += (1 << _bits) - _total;
+        return _kernel;
+    }
 }; // namespace Gaussian
 
 #endif
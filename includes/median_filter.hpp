@@ -0,0 +1,124 @@
+#ifndef MEDIAN_FILTER_HPP
+#define MEDIAN_FILTER_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+
+#pragma region median_filter
+/// @brief Median over a (2 * _radius + 1) square window per channel, edges replicated
+/// Perreault-Hebert: every column keeps a histogram of the window rows, the window histogram slides along a row
+/// by adding one column histogram and removing another, so the cost per pixel doesn't grow with the radius.
+/// Histograms are split into 16 coarse and 256 fine bins. Only the coarse window bins move with every pixel, a
+/// segment of 16 fine bins is brought up to date when the median search enters it, so the median is found in
+/// at most 32 steps and a window mostly touches one or two fine segments along a row.
+/// Row bands run in parallel, each with its own column histograms. `_src` and `_dst` must not overlap
+template <class Format>
+void median_filter(const image_view<Format> &_src, const image_view<Format> &_dst, size_t _radius)
+{
+    static_assert(sizeof(typename Format::channel) == 1, "the histograms assume 8 bit channels");
+    constexpr size_t _c = Format::channels;
+    const size_t _width = _src.width(), _height = _src.height();
+    if (_src.empty())
+        return;
+
+    const int _r = static_cast<int>(_radius);
+    const uint32_t _rank = static_cast<uint32_t>((2 * _radius + 1) * (2 * _radius + 1) / 2); // zero based median
+    auto _clamp_x = [&](int _x)
+    { return static_cast<size_t>(std::clamp(_x, 0, static_cast<int>(_width) - 1)); };
+    auto _clamp_y = [&](int _y)
+    { return static_cast<size_t>(std::clamp(_y, 0, static_cast<int>(_height) - 1)); };
+
+    parallel_for(_height, [&](size_t _begin, size_t _end)
+                 {
+        tracked_vector<uint16_t> _fine(_width * 256), _coarse(_width * 16);
+        uint32_t _kfine[256], _kcoarse[16];
+        size_t _fresh[16]; // column each fine segment of the window was last brought up to, SIZE_MAX when never
+
+        for (size_t _ch = 0; _ch < _c; _ch++)
+        {
+            auto _column_add = [&](size_t _y, int _delta)
+            {
+                const BYTE *_in = _src.channels(_y) + _ch;
+                for (size_t _x = 0; _x < _width; _x++)
+                {
+                    BYTE _v = _in[_x * _c];
+                    _fine[_x * 256 + _v] += _delta;
+                    _coarse[_x * 16 + (_v >> 4)] += _delta;
+                }
+            };
+            auto _coarse_add = [&](size_t _x, int _sign)
+            {
+                const uint16_t *_k = &_coarse[_x * 16];
+                for (int _i = 0; _i < 16; _i++)
+                    _kcoarse[_i] += _sign * _k[_i];
+            };
+            auto _segment_add = [&](size_t _seg, size_t _x, int _sign)
+            {
+                const uint16_t *_f = &_fine[_x * 256 + _seg * 16];
+                uint32_t *_k = &_kfine[_seg * 16];
+                for (int _i = 0; _i < 16; _i++)
+                    _k[_i] += _sign * _f[_i];
+            };
+            // brings fine segment `_seg` up to the window at `_x`, stepping column by column when that is
+            // cheaper than summing the whole window again
+            auto _refresh = [&](size_t _seg, size_t _x)
+            {
+                if (_fresh[_seg] == _x)
+                    return;
+                if (_fresh[_seg] == SIZE_MAX || 2 * (_x - _fresh[_seg]) > 2 * _radius + 1)
+                {
+                    std::fill(&_kfine[_seg * 16], &_kfine[_seg * 16 + 16], 0);
+                    for (int _dx = -_r; _dx <= _r; _dx++)
+                        _segment_add(_seg, _clamp_x(static_cast<int>(_x) + _dx), 1);
+                }
+                else
+                    for (size_t _j = _fresh[_seg] + 1; _j <= _x; _j++)
+                    {
+                        _segment_add(_seg, _clamp_x(static_cast<int>(_j) - _r - 1), -1);
+                        _segment_add(_seg, _clamp_x(static_cast<int>(_j) + _r), 1);
+                    }
+                _fresh[_seg] = _x;
+            };
+
+            std::fill(_fine.begin(), _fine.end(), 0);
+            std::fill(_coarse.begin(), _coarse.end(), 0);
+            for (int _dy = -_r; _dy <= _r; _dy++)
+                _column_add(_clamp_y(static_cast<int>(_begin) + _dy), 1);
+
+            for (size_t _y = _begin; _y < _end; _y++)
+            {
+                if (_y > _begin)
+                {
+                    _column_add(_clamp_y(static_cast<int>(_y) - _r - 1), -1);
+                    _column_add(_clamp_y(static_cast<int>(_y) + _r), 1);
+                }
+
+                std::fill(std::begin(_kcoarse), std::end(_kcoarse), 0);
+                std::fill(std::begin(_fresh), std::end(_fresh), SIZE_MAX);
+                for (int _dx = -_r; _dx <= _r; _dx++)
+                    _coarse_add(_clamp_x(_dx), 1);
+
+                BYTE *_out = _dst.channels(_y) + _ch;
+                for (size_t _x = 0; _x < _width; _x++)
+                {
+                    if (_x > 0)
+                    {
+                        _coarse_add(_clamp_x(static_cast<int>(_x) - _r - 1), -1);
+                        _coarse_add(_clamp_x(static_cast<int>(_x) + _r), 1);
+                    }
+                    uint32_t _seen = 0;
+                    size_t _bin = 0;
+                    while (_seen + _kcoarse[_bin] <= _rank)
+                        _seen += _kcoarse[_bin++];
+                    _refresh(_bin, _x);
+                    size_t _value = _bin * 16;
+                    while (_seen + _kfine[_value] <= _rank)
+                        _seen += _kfine[_value++];
+                    _out[_x * _c] = static_cast<BYTE>(_value);
+                }
+            }
+        } }, 2 * _radius + 1);
+}
+#pragma endregion
+
+#endif
@@ -0,0 +1,279 @@
+#ifndef MEMORY_TRACKING_HPP
+#define MEMORY_TRACKING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+
+#pragma region allocator_hook
+/// @brief Where tracked buffers get their memory from, replace it to put image and codec buffers in a pool,
+/// huge pages or a debugging allocator. Set it before any tracked buffer exists, buffers are given back to the
+/// hook that was current when they are freed
+struct allocator_hook
+{
+    void *(*allocate)(size_t _bytes, size_t _alignment);             // nullptr when out of memory
+    void (*deallocate)(void *_ptr, size_t _bytes, size_t _alignment); // same bytes and alignment as allocated
+};
+
+namespace memory_detail
+{
+    void *default_allocate(size_t _bytes, size_t _alignment)
+    {
+        return ::operator new(_bytes, std::align_val_t(_alignment), std::nothrow);
+    }
+
+    void default_deallocate(void *_ptr, size_t, size_t _alignment)
+    {
+        ::operator delete(_ptr, std::align_val_t(_alignment));
+    }
+
+    allocator_hook &hook()
+    {
+        static allocator_hook _hook{default_allocate, default_deallocate};
+        return _hook;
+    }
+}; // namespace
+
+/// @return the hook it replaced
+allocator_hook set_allocator_hook(allocator_hook _hook)
+{
+    allocator_hook _old = memory_detail::hook();
+    memory_detail::hook() = _hook;
+    return _old;
+}
+#pragma endregion
+
+#pragma region memory_scope
+struct memory_stats
+{
+    size_t live_bytes{};  // allocated and not yet freed
+    size_t peak_bytes{};  // highest live_bytes seen
+    size_t allocations{};
+    size_t frees{};
+    size_t refused{};     // allocations that would have gone over a limit
+};
+
+namespace memory_detail
+{
+    /// @brief Counters of one scope, kept alive by the scope, its child scopes and every buffer allocated in it
+    /// so a buffer outliving its scope still finds the counters to give its bytes back to
+    struct scope_state
+    {
+        std::atomic<size_t> live{}, peak{}, allocations{}, frees{}, refused{};
+        std::atomic<size_t> refs{1};
+        size_t limit = SIZE_MAX;
+        scope_state *parent = nullptr;
+        std::string name;
+
+        memory_stats stats() const { return {live.load(), peak.load(), allocations.load(), frees.load(), refused.load()}; }
+    };
+
+    /// @brief counts everything, never freed
+    scope_state &process_state()
+    {
+        static scope_state *_state = new scope_state{};
+        return *_state;
+    }
+
+    /// @brief innermost scope of the calling thread
+    scope_state *&current_state()
+    {
+        thread_local scope_state *_state = &process_state();
+        return _state;
+    }
+
+    void release(scope_state *_state)
+    {
+        while (_state && _state->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            scope_state *_parent = _state->parent;
+            delete _state;
+            _state = _parent;
+        }
+    }
+
+    /// @brief adds `_bytes` to `_state` and every scope around it
+    /// @return false, with nothing charged and no peak moved, when any of them would go over its limit
+    bool charge(scope_state *_state, size_t _bytes)
+    {
+        // live is reserved scope by scope so concurrent charges can't both slip under a limit, peaks are only
+        // raised once the whole chain has room
+        for (scope_state *_s = _state; _s; _s = _s->parent)
+        {
+            size_t _live = _s->live.fetch_add(_bytes, std::memory_order_relaxed) + _bytes;
+            if (_live > _s->limit)
+            {
+                _s->refused.fetch_add(1, std::memory_order_relaxed);
+                for (scope_state *_undo = _state; _undo != _s->parent; _undo = _undo->parent)
+                    _undo->live.fetch_sub(_bytes, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        for (scope_state *_s = _state; _s; _s = _s->parent)
+        {
+            size_t _live = _s->live.load(std::memory_order_relaxed);
+            size_t _peak = _s->peak.load(std::memory_order_relaxed);
+            while (_live > _peak && !_s->peak.compare_exchange_weak(_peak, _live, std::memory_order_relaxed))
+                ;
+            _s->allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /// @brief takes back a charge whose memory never got allocated, counted as neither allocation nor free
+    void uncharge(scope_state *_state, size_t _bytes)
+    {
+        for (scope_state *_s = _state; _s; _s = _s->parent)
+        {
+            _s->live.fetch_sub(_bytes, std::memory_order_relaxed);
+            _s->allocations.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    void discharge(scope_state *_state, size_t _bytes)
+    {
+        for (scope_state *_s = _state; _s; _s = _s->parent)
+        {
+            _s->live.fetch_sub(_bytes, std::memory_order_relaxed);
+            _s->frees.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /// @brief every tracked block starts with the scope it was charged to
+    struct block_header
+    {
+        scope_state *state;
+    };
+
+    constexpr size_t block_alignment(size_t _alignment)
+    {
+        return std::max(_alignment, alignof(std::max_align_t));
+    }
+
+    constexpr size_t header_size(size_t _alignment)
+    {
+        return (sizeof(block_header) + block_alignment(_alignment) - 1) / block_alignment(_alignment) * block_alignment(_alignment);
+    }
+}; // namespace
+
+/// @brief Counts the tracked memory allocated by the calling thread while it is alive
+/// Scopes nest, an allocation counts towards the innermost scope and every scope around it. parallel_for
+/// workers count towards the scope of the thread that started them. Bytes are given back to the scope they
+/// were charged to whenever they are freed, even after the scope ended. Only buffers using tracked_allocator
+/// are seen: image storage and the codec and file buffers
+class memory_scope
+{
+private:
+    memory_detail::scope_state *m_state;
+
+public:
+    /// @param limit bytes live at once in this scope, an allocation going over it throws std::bad_alloc
+    explicit memory_scope(std::string name = "", size_t limit = SIZE_MAX) : m_state(new memory_detail::scope_state{})
+    {
+        m_state->name = std::move(name);
+        m_state->limit = limit;
+        m_state->parent = memory_detail::current_state();
+        m_state->parent->refs.fetch_add(1, std::memory_order_relaxed);
+        memory_detail::current_state() = m_state;
+    }
+
+    memory_scope(const memory_scope &) = delete;
+    memory_scope &operator=(const memory_scope &) = delete;
+
+    /// @note scopes of a thread must end in the reverse order they started
+    ~memory_scope()
+    {
+        memory_detail::current_state() = m_state->parent;
+        memory_detail::release(m_state);
+    }
+
+    memory_stats stats() const { return m_state->stats(); }
+    const std::string &name() const { return m_state->name; }
+    size_t limit() const { return m_state->limit; }
+
+    /// @brief totals over every tracked buffer of the process
+    static memory_stats process_stats() { return memory_detail::process_state().stats(); }
+};
+
+/// @brief Makes the calling thread count towards the scope current on another thread, for worker threads
+/// whose allocations belong to the operation that started them
+class memory_scope_binding
+{
+private:
+    memory_detail::scope_state *m_previous;
+
+public:
+    /// @param state the other thread's memory_detail::current_state(), alive until this binding ends
+    explicit memory_scope_binding(memory_detail::scope_state *state) : m_previous(memory_detail::current_state())
+    {
+        memory_detail::current_state() = state;
+    }
+
+    memory_scope_binding(const memory_scope_binding &) = delete;
+    memory_scope_binding &operator=(const memory_scope_binding &) = delete;
+
+    ~memory_scope_binding() { memory_detail::current_state() = m_previous; }
+};
+
+/// @brief Allocates through the allocator hook and charges the current scopes
+/// @throws std::bad_alloc over a scope limit or when the hook is out of memory
+void *tracked_allocate(size_t _bytes, size_t _alignment)
+{
+    memory_detail::scope_state *_state = memory_detail::current_state();
+    if (!memory_detail::charge(_state, _bytes))
+        throw std::bad_alloc();
+    size_t _header = memory_detail::header_size(_alignment);
+    void *_block = _bytes > SIZE_MAX - _header ? nullptr : memory_detail::hook().allocate(_header + _bytes, memory_detail::block_alignment(_alignment));
+    if (!_block)
+    {
+        memory_detail::uncharge(_state, _bytes);
+        throw std::bad_alloc();
+    }
+    _state->refs.fetch_add(1, std::memory_order_relaxed);
+    static_cast<memory_detail::block_header *>(_block)->state = _state;
+    return static_cast<char *>(_block) + _header;
+}
+
+void tracked_deallocate(void *_ptr, size_t _bytes, size_t _alignment)
+{
+    if (!_ptr)
+        return;
+    size_t _header = memory_detail::header_size(_alignment);
+    void *_block = static_cast<char *>(_ptr) - _header;
+    memory_detail::scope_state *_state = static_cast<memory_detail::block_header *>(_block)->state;
+    memory_detail::discharge(_state, _bytes);
+    memory_detail::release(_state);
+    memory_detail::hook().deallocate(_block, _header + _bytes, memory_detail::block_alignment(_alignment));
+}
+
+/// @brief Standard allocator over tracked_allocate, for containers holding pixel or codec data
+template <class T>
+struct tracked_allocator
+{
+    using value_type = T;
+
+    tracked_allocator() = default;
+    template <class U>
+    tracked_allocator(const tracked_allocator<U> &) {}
+
+    T *allocate(size_t _n)
+    {
+        if (_n > SIZE_MAX / sizeof(T))
+            throw std::bad_alloc();
+        return static_cast<T *>(tracked_allocate(_n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *_ptr, size_t _n) { tracked_deallocate(_ptr, _n * sizeof(T), alignof(T)); }
+
+    template <class U>
+    bool operator==(const tracked_allocator<U> &) const { return true; }
+};
+
+template <class T>
+using tracked_vector = std::vector<T, tracked_allocator<T>>;
+#pragma endregion
+
+#endif
@@ -0,0 +1,351 @@
+#ifndef MORPHOLOGY_HPP
+#define MORPHOLOGY_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+
+#pragma region morphology
+enum class morph_op
+{
+    erode,  // minimum over the structuring element
+    dilate, // maximum over the structuring element
+    open,   // erode then dilate, removes specks smaller than the element
+    close   // dilate then erode, fills gaps smaller than the element
+};
+
+namespace morph_detail
+{
+    template <class T>
+    struct min_op
+    {
+        T operator()(T _a, T _b) const { return _a < _b ? _a : _b; }
+    };
+    template <class T>
+    struct max_op
+    {
+        T operator()(T _a, T _b) const { return _a > _b ? _a : _b; }
+    };
+    struct and_op
+    {
+        uint64_t operator()(uint64_t _a, uint64_t _b) const { return _a & _b; }
+    };
+    struct or_op
+    {
+        uint64_t operator()(uint64_t _a, uint64_t _b) const { return _a | _b; }
+    };
+
+    /// @brief van Herk / Gil-Werman running min or max over `_n` rows of `_length` elements, window `_w` rows
+    /// anchored at `_w / 2`. Rows outside the image read as `_pad`. The padded rows are cut into blocks of `_w`;
+    /// a prefix pass and a suffix pass within each block let every window be answered with one more op, so the
+    /// cost is three ops per element whatever `_w` is. Whole rows are combined at a time, split over column bands
+    template <class T, class Op, class InRow, class OutRow>
+    void vhgw_rows(InRow &&_in_row, OutRow &&_out_row, size_t _n, size_t _length, size_t _w, T _pad, Op _op)
+    {
+        if (_n == 0 || _length == 0)
+            return;
+        const size_t _anchor = _w / 2;
+        const size_t _padded = _n + _w - 1;
+        tracked_vector<T> _g(_padded * _length), _h(_padded * _length);
+
+        parallel_for(_length, [&](size_t _begin, size_t _end)
+                     {
+            auto _src = [&](size_t _p, size_t _i) -> T
+            {
+                return _p < _anchor || _p - _anchor >= _n ? _pad : _in_row(_p - _anchor)[_i];
+            };
+            for (size_t _p = 0; _p < _padded; _p++)
+            {
+                T *_gp = &_g[_p * _length];
+                if (_p % _w == 0)
+                {
+                    for (size_t _i = _begin; _i < _end; _i++)
+                        _gp[_i] = _src(_p, _i);
+                }
+                else
+                {
+                    const T *_prev = _gp - _length;
+                    for (size_t _i = _begin; _i < _end; _i++)
+                        _gp[_i] = _op(_prev[_i], _src(_p, _i));
+                }
+            }
+            for (size_t _p = _padded; _p-- > 0;)
+            {
+                T *_hp = &_h[_p * _length];
+                if (_p % _w == _w - 1 || _p == _padded - 1)
+                {
+                    for (size_t _i = _begin; _i < _end; _i++)
+                        _hp[_i] = _src(_p, _i);
+                }
+                else
+                {
+                    const T *_next = _hp + _length;
+                    for (size_t _i = _begin; _i < _end; _i++)
+                        _hp[_i] = _op(_next[_i], _src(_p, _i));
+                }
+            }
+            for (size_t _y = 0; _y < _n; _y++)
+            {
+                const T *_hp = &_h[_y * _length];
+                const T *_gp = &_g[(_y + _w - 1) * _length];
+                T *_out = _out_row(_y);
+                for (size_t _i = _begin; _i < _end; _i++)
+                    _out[_i] = _op(_hp[_i], _gp[_i]);
+            } }, 64);
+    }
+
+    /// @brief same as vhgw_rows along one line of `_n` values `_step` elements apart
+    template <class T, class Op>
+    void vhgw_line(const T *_in, T *_out, size_t _n, size_t _step, size_t _w, T _pad, Op _op, tracked_vector<T> &_g, tracked_vector<T> &_h)
+    {
+        const size_t _anchor = _w / 2;
+        const size_t _padded = _n + _w - 1;
+        _g.resize(_padded);
+        _h.resize(_padded);
+        auto _src = [&](size_t _p) -> T
+        { return _p < _anchor || _p - _anchor >= _n ? _pad : _in[(_p - _anchor) * _step]; };
+        for (size_t _p = 0; _p < _padded; _p++)
+            _g[_p] = _p % _w == 0 ? _src(_p) : _op(_g[_p - 1], _src(_p));
+        for (size_t _p = _padded; _p-- > 0;)
+            _h[_p] = _p % _w == _w - 1 || _p == _padded - 1 ? _src(_p) : _op(_h[_p + 1], _src(_p));
+        for (size_t _x = 0; _x < _n; _x++)
+            _out[_x * _step] = _op(_h[_x], _g[_x + _w - 1]);
+    }
+
+    template <class Format, class Op>
+    void rect_min_max(const image_view<Format> &_src, const image_view<Format> &_dst, size_t _w, size_t _h, typename Format::channel _pad, Op _op)
+    {
+        using channel = typename Format::channel;
+        constexpr size_t _c = Format::channels;
+        _w = std::max<size_t>(_w, 1);
+        _h = std::max<size_t>(_h, 1);
+
+        // horizontal pass into a scratch image, row bands in parallel
+        image<Format> _tmp(_src.width(), _src.height());
+        parallel_for(_src.height(), [&](size_t _begin, size_t _end)
+                     {
+            tracked_vector<channel> _g, _hb;
+            for (size_t _y = _begin; _y < _end; _y++)
+            {
+                for (size_t _ch = 0; _ch < _c; _ch++)
+                    vhgw_line(_src.channels(_y) + _ch, _tmp.view().channels(_y) + _ch, _src.width(), _c, _w, _pad, _op, _g, _hb);
+            } }, 16);
+
+        image_view<Format> _tmp_view = _tmp.view();
+        vhgw_rows<channel>([&](size_t _y)
+                           { return _tmp_view.channels(_y); }, [&](size_t _y)
+                           { return _dst.channels(_y); }, _src.height(), _src.width() * _c, _h, _pad, _op);
+    }
+}; // namespace morph_detail
+
+/// @brief Grayscale morphology with a `_w` x `_h` rectangle anchored at its centre, per channel
+/// pixels outside the image are ignored. `_src` and `_dst` may be the same view
+template <class Format>
+void morphology(const image_view<Format> &_src, const image_view<Format> &_dst, morph_op _op, size_t _w, size_t _h)
+{
+    using channel = typename Format::channel;
+    constexpr channel _max = std::numeric_limits<channel>::max();
+    switch (_op)
+    {
+    case morph_op::erode:
+        morph_detail::rect_min_max(_src, _dst, _w, _h, _max, morph_detail::min_op<channel>());
+        break;
+    case morph_op::dilate:
+        morph_detail::rect_min_max(_src, _dst, _w, _h, channel(0), morph_detail::max_op<channel>());
+        break;
+    case morph_op::open:
+        morph_detail::rect_min_max(_src, _dst, _w, _h, _max, morph_detail::min_op<channel>());
+        morph_detail::rect_min_max(_dst, _dst, _w, _h, channel(0), morph_detail::max_op<channel>());
+        break;
+    case morph_op::close:
+        morph_detail::rect_min_max(_src, _dst, _w, _h, channel(0), morph_detail::max_op<channel>());
+        morph_detail::rect_min_max(_dst, _dst, _w, _h, _max, morph_detail::min_op<channel>());
+        break;
+    }
+}
+
+/// @brief Binary image with 64 pixels per word, pixel x of a row is bit x % 64 of word x / 64
+class bit_mask
+{
+private:
+    size_t m_width{}, m_height{}, m_words{};
+    tracked_vector<uint64_t> m_bits;
+
+    /// @brief bits past the width in the last word of a row
+    uint64_t tail_mask() const { return m_width % 64 ? (uint64_t(1) << (m_width % 64)) - 1 : ~uint64_t(0); }
+
+    /// @brief `_out` bit x = `_in` bit x + _shift, bits shifted in from past the row are 0
+    void shift_down(const uint64_t *_in, uint64_t *_out, size_t _shift) const
+    {
+        size_t _word_shift = _shift / 64, _bit_shift = _shift % 64;
+        for (size_t _i = 0; _i < m_words; _i++)
+        {
+            size_t _src = _i + _word_shift;
+            uint64_t _lo = _src < m_words ? _in[_src] : 0;
+            uint64_t _hi = _src + 1 < m_words ? _in[_src + 1] : 0;
+            _out[_i] = _bit_shift ? (_lo >> _bit_shift) | (_hi << (64 - _bit_shift)) : _lo;
+        }
+    }
+
+    /// @brief `_out` bit x = `_in` bit x - _shift, bits shifted in from before the row are 0
+    void shift_up(const uint64_t *_in, uint64_t *_out, size_t _shift) const
+    {
+        size_t _word_shift = _shift / 64, _bit_shift = _shift % 64;
+        for (size_t _i = m_words; _i-- > 0;)
+        {
+            uint64_t _hi = _i >= _word_shift ? _in[_i - _word_shift] : 0;
+            uint64_t _lo = _i >= _word_shift + 1 ? _in[_i - _word_shift - 1] : 0;
+            _out[_i] = _bit_shift ? (_hi << _bit_shift) | (_lo >> (64 - _bit_shift)) : _hi;
+        }
+    }
+
+    /// @brief `_out` bit x = OR of `_in` bits [x, x + _len) when `_forward`, else of (x - _len, x]
+    /// runs double in length with every shifted OR, so a run costs log2(_len) passes over the row words
+    void run_or(const uint64_t *_in, uint64_t *_out, size_t _len, bool _forward, tracked_vector<uint64_t> &_span, tracked_vector<uint64_t> &_tmp) const
+    {
+        auto _shift = [&](const uint64_t *_from, uint64_t *_to, size_t _by)
+        {
+            if (_forward)
+                shift_down(_from, _to, _by);
+            else
+                shift_up(_from, _to, _by);
+        };
+        // _span holds runs of _have_span pixels, _out runs of _have pixels
+        std::copy(_in, _in + m_words, _span.begin());
+        std::fill(_out, _out + m_words, 0);
+        size_t _have_span = 1, _have = 0;
+        for (size_t _rest = _len; _rest; _rest >>= 1)
+        {
+            if (_rest & 1)
+            {
+                _shift(_span.data(), _tmp.data(), _have);
+                for (size_t _i = 0; _i < m_words; _i++)
+                    _out[_i] |= _tmp[_i];
+                _have += _have_span;
+            }
+            if (_rest > 1)
+            {
+                _shift(_span.data(), _tmp.data(), _have_span);
+                for (size_t _i = 0; _i < m_words; _i++)
+                    _span[_i] |= _tmp[_i];
+                _have_span *= 2;
+            }
+        }
+    }
+
+    /// @brief OR of each row over a `_w` wide window anchored at its centre, as the run back to the anchor
+    /// joined with the run forward from it, so bits past either end of the row read as 0
+    void dilate_rows(tracked_vector<uint64_t> &_bits, size_t _w) const
+    {
+        parallel_for(m_height, [&](size_t _begin, size_t _end)
+                     {
+            tracked_vector<uint64_t> _span(m_words), _tmp(m_words), _back(m_words);
+            for (size_t _y = _begin; _y < _end; _y++)
+            {
+                uint64_t *_row = &_bits[_y * m_words];
+                run_or(_row, _back.data(), _w / 2 + 1, false, _span, _tmp);
+                run_or(_row, _row, _w - _w / 2, true, _span, _tmp);
+                for (size_t _i = 0; _i < m_words; _i++)
+                    _row[_i] |= _back[_i];
+                _row[m_words - 1] &= tail_mask();
+            } }, 16);
+    }
+
+    void dilate_in_place(size_t _w, size_t _h)
+    {
+        dilate_rows(m_bits, std::max<size_t>(_w, 1));
+        tracked_vector<uint64_t> _out(m_bits.size());
+        morph_detail::vhgw_rows<uint64_t>([&](size_t _y)
+                                          { return &m_bits[_y * m_words]; }, [&](size_t _y)
+                                          { return &_out[_y * m_words]; }, m_height, m_words, std::max<size_t>(_h, 1), uint64_t(0), morph_detail::or_op());
+        m_bits.swap(_out);
+    }
+
+    void invert_in_place()
+    {
+        for (size_t _y = 0; _y < m_height; _y++)
+        {
+            uint64_t *_row = &m_bits[_y * m_words];
+            for (size_t _i = 0; _i < m_words; _i++)
+                _row[_i] = ~_row[_i];
+            _row[m_words - 1] &= tail_mask();
+        }
+    }
+
+public:
+    bit_mask() = default;
+    bit_mask(size_t width, size_t height) : m_width(width), m_height(height), m_words((width + 63) / 64), m_bits(m_words * height) {}
+
+    /// @brief set where the pixel is above `_threshold`, e.g. on edge_detection output turned gray
+    static bit_mask from_threshold(const image_view<pixel_format::gray8> &_src, BYTE _threshold = 127)
+    {
+        bit_mask _mask(_src.width(), _src.height());
+        for (size_t _y = 0; _y < _src.height(); _y++)
+        {
+            const BYTE *_in = _src.row(_y);
+            uint64_t *_row = &_mask.m_bits[_y * _mask.m_words];
+            for (size_t _x = 0; _x < _src.width(); _x++)
+                _row[_x / 64] |= uint64_t(_in[_x] > _threshold) << (_x % 64);
+        }
+        return _mask;
+    }
+
+    /// @brief 255 where set, 0 elsewhere
+    image_gray8 to_image() const
+    {
+        image_gray8 _img(m_width, m_height);
+        for (size_t _y = 0; _y < m_height; _y++)
+        {
+            const uint64_t *_row = &m_bits[_y * m_words];
+            BYTE *_out = _img.row(_y);
+            for (size_t _x = 0; _x < m_width; _x++)
+                _out[_x] = (_row[_x / 64] >> (_x % 64)) & 1 ? 255 : 0;
+        }
+        return _img;
+    }
+
+    bool get(size_t _x, size_t _y) const { return (m_bits[_y * m_words + _x / 64] >> (_x % 64)) & 1; }
+    void set(size_t _x, size_t _y, bool _on)
+    {
+        uint64_t &_word = m_bits[_y * m_words + _x / 64];
+        _word = _on ? _word | (uint64_t(1) << (_x % 64)) : _word & ~(uint64_t(1) << (_x % 64));
+    }
+
+    /// @brief binary morphology with a `_w` x `_h` rectangle, pixels outside the mask are ignored
+    /// erosion is the complement of dilating the complement, which keeps the outside neutral for both
+    bit_mask morphology(morph_op _op, size_t _w, size_t _h) const
+    {
+        bit_mask _res = *this;
+        if (m_words == 0 || m_height == 0)
+            return _res;
+        auto _erode = [&]
+        {
+            _res.invert_in_place();
+            _res.dilate_in_place(_w, _h);
+            _res.invert_in_place();
+        };
+        switch (_op)
+        {
+        case morph_op::erode:
+            _erode();
+            break;
+        case morph_op::dilate:
+            _res.dilate_in_place(_w, _h);
+            break;
+        case morph_op::open:
+            _erode();
+            _res.dilate_in_place(_w, _h);
+            break;
+        case morph_op::close:
+            _res.dilate_in_place(_w, _h);
+            _erode();
+            break;
+        }
+        return _res;
+    }
+
+    size_t width() const { return m_width; }
+    size_t height() const { return m_height; }
+};
+#pragma endregion
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef PYRAMID_HPP
+#define PYRAMID_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+#include "math_utils.hpp"
+
+#pragma region pyramid
+enum class pyramid_filter
+{
+    box,     // mean of each 2x2 block
+    gaussian // 5 tap gaussian from Gaussian::GaussianKernel1D, then every other pixel
+};
+
+/// @brief Halves `_src` into `_dst` with a separable kernel evaluated only at the kept pixels
+/// each source row is filtered horizontally once into a small ring of rows, then the ring is combined vertically
+/// @param _taps weights summing to 1 << _bits
+/// @param _origin offset of the first tap from 2x, e.g. -2 for a centred 5 tap kernel
+template <class Format>
+void pyramid_down(const image_view<Format> &_src, const image_view<Format> &_dst, const std::vector<int> &_taps, int _origin, int _bits)
+{
+    using channel = typename Format::channel;
+    constexpr size_t _c = Format::channels;
+    const int _n = static_cast<int>(_taps.size());
+    const int _src_w = static_cast<int>(_src.width()), _src_h = static_cast<int>(_src.height());
+    const size_t _dst_row = _dst.width() * _c;
+    // horizontal sums carry _bits of fraction, the vertical pass adds another _bits
+    const uint32_t _round = uint32_t(1) << (2 * _bits - 1);
+
+    parallel_for(_dst.height(), [&](size_t _begin, size_t _end)
+                 {
+        tracked_vector<uint32_t> _ring(_n * _dst_row);
+        std::vector<int> _held(_n, -1); // source row each ring slot holds
+
+        auto _filtered_row = [&](int _sy) -> const uint32_t *
+        {
+            _sy = std::clamp(_sy, 0, _src_h - 1);
+            int _slot = _sy % _n;
+            uint32_t *_out = &_ring[_slot * _dst_row];
+            if (_held[_slot] == _sy)
+                return _out;
+            _held[_slot] = _sy;
+
+            const channel *_in = _src.channels(_sy);
+            for (size_t _x = 0; _x < _dst.width(); _x++)
+            {
+                int _sx = 2 * static_cast<int>(_x) + _origin;
+                uint32_t _acc[_c] = {};
+                for (int _k = 0; _k < _n; _k++)
+                {
+                    const channel *_px = _in + std::clamp(_sx + _k, 0, _src_w - 1) * _c;
+                    for (size_t _ch = 0; _ch < _c; _ch++)
+                        _acc[_ch] += uint32_t(_taps[_k]) * _px[_ch];
+                }
+                for (size_t _ch = 0; _ch < _c; _ch++)
+                    _out[_x * _c + _ch] = _acc[_ch];
+            }
+            return _out;
+        };
+
+        std::vector<const uint32_t *> _rows(_n);
+        for (size_t _y = _begin; _y < _end; _y++)
+        {
+            for (int _k = 0; _k < _n; _k++)
+                _rows[_k] = _filtered_row(2 * static_cast<int>(_y) + _origin + _k);
+            channel *_out = _dst.channels(_y);
+            for (size_t _i = 0; _i < _dst_row; _i++)
+            {
+                uint32_t _acc = 0;
+                for (int _k = 0; _k < _n; _k++)
+                    _acc += uint32_t(_taps[_k]) * _rows[_k][_i];
+                _out[_i] = static_cast<channel>((_acc + _round) >> (2 * _bits));
+            }
+        } }, 8);
+}
+
+/// @brief Successive 2x downsampled levels of an image, all held in one allocation
+/// level 0 is a copy of the source, level i is ceil(size / 2^i) down to 1x1 or `max_levels`
+template <class Format>
+class image_pyramid
+{
+public:
+    using pixel = typename Format::pixel;
+
+private:
+    struct level_info
+    {
+        size_t offset, width, height;
+        ptrdiff_t stride;
+    };
+    tracked_vector<BYTE> m_storage;
+    std::vector<level_info> m_levels;
+
+public:
+    image_pyramid(const image_view<Format> &src, pyramid_filter filter = pyramid_filter::gaussian, size_t max_levels = SIZE_MAX)
+    {
+        size_t _width = src.width(), _height = src.height(), _offset = 0;
+        while (m_levels.size() < max_levels && _width && _height)
+        {
+            size_t _row_bytes = _width * sizeof(pixel);
+            ptrdiff_t _stride = static_cast<ptrdiff_t>((_row_bytes + image<Format>::row_alignment - 1) / image<Format>::row_alignment * image<Format>::row_alignment);
+            m_levels.push_back({_offset, _width, _height, _stride});
+            _offset += static_cast<size_t>(_stride) * _height;
+            if (_width == 1 && _height == 1)
+                break;
+            _width = (_width + 1) / 2;
+            _height = (_height + 1) / 2;
+        }
+        m_storage.resize(_offset);
+        if (m_levels.empty())
+            return;
+
+        image_view<Format> _base = level(0);
+        for (size_t _row = 0; _row < _base.height(); _row++)
+            std::memcpy(_base.row(_row), src.row(_row), _base.row_bytes());
+
+        std::vector<int> _taps = filter == pyramid_filter::box ? std::vector<int>{1, 1} : Gaussian::GaussianKernel1D(5, 1.0f, 8);
+        int _origin = filter == pyramid_filter::box ? 0 : -2;
+        int _bits = filter == pyramid_filter::box ? 1 : 8;
+        for (size_t _l = 1; _l < m_levels.size(); _l++)
+            pyramid_down(level(_l - 1), level(_l), _taps, _origin, _bits);
+    }
+
+    size_t levels() const { return m_levels.size(); }
+
+    image_view<Format> level(size_t _l) const
+    {
+        const level_info &_info = m_levels[_l];
+        return image_view<Format>(const_cast<BYTE *>(m_storage.data()) + _info.offset, _info.width, _info.height, _info.stride);
+    }
+};
+#pragma endregion
+
+#endif
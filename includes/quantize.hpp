@@ -0,0 +1,272 @@
+#ifndef QUANTIZE_HPP
+#define QUANTIZE_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+#include <mutex>
+
+#pragma region quantize
+namespace quantize_detail
+{
+    /// @brief bits kept per channel by the colour histogram and the inverse colour map
+    constexpr size_t cell_bits = 5;
+    constexpr size_t cell_levels = size_t(1) << cell_bits;
+    constexpr size_t cells = cell_levels * cell_levels * cell_levels;
+
+    /// @brief cell of a colour, red in the high bits
+    size_t cell_of(unsigned _b, unsigned _g, unsigned _r)
+    {
+        constexpr unsigned _shift = 8 - cell_bits;
+        return ((_r >> _shift) << (2 * cell_bits)) | ((_g >> _shift) << cell_bits) | (_b >> _shift);
+    }
+
+    /// @brief pixels and channel sums of the colours falling into one cell
+    struct colour_bin
+    {
+        uint64_t count;
+        uint64_t sum[3]; // blue, green, red
+    };
+
+    template <class Format>
+    std::vector<colour_bin> colour_histogram(const image_view<Format> &_img)
+    {
+        std::vector<colour_bin> _total(cells, colour_bin{});
+        std::mutex _merge;
+        parallel_for(_img.height(), [&](size_t _begin, size_t _end)
+                     {
+            std::vector<colour_bin> _local(cells, colour_bin{});
+            for (size_t _y = _begin; _y < _end; _y++)
+            {
+                const BYTE *_px = _img.channels(_y);
+                for (size_t _x = 0; _x < _img.width(); _x++, _px += Format::channels)
+                {
+                    colour_bin &_bin = _local[cell_of(_px[Format::blue], _px[Format::green], _px[Format::red])];
+                    _bin.count++;
+                    _bin.sum[0] += _px[Format::blue];
+                    _bin.sum[1] += _px[Format::green];
+                    _bin.sum[2] += _px[Format::red];
+                }
+            }
+            std::lock_guard<std::mutex> _lock(_merge);
+            for (size_t _i = 0; _i < cells; _i++)
+            {
+                _total[_i].count += _local[_i].count;
+                for (size_t _c = 0; _c < 3; _c++)
+                    _total[_i].sum[_c] += _local[_i].sum[_c];
+            } }, 64);
+        return _total;
+    }
+
+    /// @brief channel `_c` (0 blue, 1 green, 2 red) of a cell index
+    unsigned cell_channel(size_t _cell, size_t _c)
+    {
+        return static_cast<unsigned>(_cell >> (_c * cell_bits)) & (cell_levels - 1);
+    }
+
+    /// @brief run of occupied cells `[begin, end)` in the cell list, with its extent along each channel
+    struct colour_box
+    {
+        size_t begin, end;
+        uint64_t count;
+        unsigned low[3], high[3];
+
+        size_t longest_axis() const
+        {
+            size_t _axis = 0;
+            for (size_t _c = 1; _c < 3; _c++)
+                if (high[_c] - low[_c] > high[_axis] - low[_axis])
+                    _axis = _c;
+            return _axis;
+        }
+    };
+
+    colour_box make_box(const std::vector<uint32_t> &_cells, const std::vector<colour_bin> &_bins, size_t _begin, size_t _end)
+    {
+        constexpr unsigned _top = cell_levels;
+        colour_box _box{_begin, _end, 0, {_top, _top, _top}, {0, 0, 0}};
+        for (size_t _i = _begin; _i < _end; _i++)
+        {
+            _box.count += _bins[_cells[_i]].count;
+            for (size_t _c = 0; _c < 3; _c++)
+            {
+                _box.low[_c] = std::min(_box.low[_c], cell_channel(_cells[_i], _c));
+                _box.high[_c] = std::max(_box.high[_c], cell_channel(_cells[_i], _c));
+            }
+        }
+        return _box;
+    }
+}; // namespace quantize_detail
+
+/// @brief Palette of at most `_colours` entries by median cut
+/// colours are counted in 5 bit per channel cells. The box with the most pixels times its longest side is cut
+/// across that side where it holds half its pixels, until there are `_colours` boxes or no box spans more than one
+/// cell. Every entry is the mean colour of the pixels in its box, not the centre of the box
+template <class Format>
+std::vector<RGBQUAD> median_cut_palette(const image_view<Format> &_img, size_t _colours = 256)
+{
+    static_assert(!Format::is_gray && sizeof(typename Format::channel) == 1, "median cut needs 8 bit colour channels");
+    using namespace quantize_detail;
+    _colours = std::clamp<size_t>(_colours, 1, 256);
+    std::vector<colour_bin> _bins = colour_histogram(_img);
+    std::vector<uint32_t> _cells;
+    for (size_t _i = 0; _i < cells; _i++)
+        if (_bins[_i].count)
+            _cells.push_back(static_cast<uint32_t>(_i));
+    if (_cells.empty())
+        return {};
+
+    std::vector<colour_box> _boxes{make_box(_cells, _bins, 0, _cells.size())};
+    while (_boxes.size() < _colours)
+    {
+        size_t _pick = SIZE_MAX;
+        uint64_t _best = 0;
+        for (size_t _b = 0; _b < _boxes.size(); _b++)
+        {
+            const colour_box &_box = _boxes[_b];
+            size_t _axis = _box.longest_axis();
+            uint64_t _score = _box.count * (_box.high[_axis] - _box.low[_axis]);
+            if (_box.end - _box.begin > 1 && _score >= _best)
+            {
+                _best = _score;
+                _pick = _b;
+            }
+        }
+        if (_pick == SIZE_MAX)
+            break;
+
+        colour_box _box = _boxes[_pick];
+        size_t _axis = _box.longest_axis();
+        std::sort(_cells.begin() + _box.begin, _cells.begin() + _box.end, [&](uint32_t _a, uint32_t _b)
+                  { return cell_channel(_a, _axis) < cell_channel(_b, _axis); });
+        // first cell past half the pixels, leaving at least one cell on either side
+        size_t _split = _box.begin + 1;
+        for (uint64_t _seen = _bins[_cells[_box.begin]].count; _split < _box.end - 1 && _seen * 2 < _box.count; _split++)
+            _seen += _bins[_cells[_split]].count;
+        _boxes[_pick] = make_box(_cells, _bins, _box.begin, _split);
+        _boxes.push_back(make_box(_cells, _bins, _split, _box.end));
+    }
+
+    std::vector<RGBQUAD> _palette;
+    for (const colour_box &_box : _boxes)
+    {
+        uint64_t _sum[3] = {};
+        for (size_t _i = _box.begin; _i < _box.end; _i++)
+            for (size_t _c = 0; _c < 3; _c++)
+                _sum[_c] += _bins[_cells[_i]].sum[_c];
+        auto _mean = [&](size_t _c)
+        { return static_cast<BYTE>((_sum[_c] + _box.count / 2) / _box.count); };
+        _palette.push_back({_mean(0), _mean(1), _mean(2), 0});
+    }
+    return _palette;
+}
+
+/// @brief Nearest palette entry of every 5 bit per channel cell, so mapping a pixel is one table lookup
+/// the entry is the nearest one to the centre of the cell, squared distance in RGB
+class inverse_colour_map
+{
+private:
+    std::vector<BYTE> m_map;
+
+public:
+    explicit inverse_colour_map(const std::vector<RGBQUAD> &palette) : m_map(quantize_detail::cells)
+    {
+        using namespace quantize_detail;
+        constexpr unsigned _half = 1u << (8 - cell_bits - 1);
+        parallel_for(cell_levels, [&](size_t _begin, size_t _end)
+                     {
+            for (size_t _r = _begin; _r < _end; _r++)
+                for (size_t _g = 0; _g < cell_levels; _g++)
+                    for (size_t _b = 0; _b < cell_levels; _b++)
+                    {
+                        int _cr = static_cast<int>((_r << (8 - cell_bits)) + _half);
+                        int _cg = static_cast<int>((_g << (8 - cell_bits)) + _half);
+                        int _cb = static_cast<int>((_b << (8 - cell_bits)) + _half);
+                        int _best = INT32_MAX;
+                        BYTE _index = 0;
+                        for (size_t _i = 0; _i < palette.size(); _i++)
+                        {
+                            int _dr = _cr - palette[_i].rgbRed, _dg = _cg - palette[_i].rgbGreen, _db = _cb - palette[_i].rgbBlue;
+                            int _d = _dr * _dr + _dg * _dg + _db * _db;
+                            if (_d < _best)
+                            {
+                                _best = _d;
+                                _index = static_cast<BYTE>(_i);
+                            }
+                        }
+                        m_map[(_r << (2 * cell_bits)) | (_g << cell_bits) | _b] = _index;
+                    } });
+    }
+
+    BYTE operator()(unsigned _b, unsigned _g, unsigned _r) const { return m_map[quantize_detail::cell_of(_b, _g, _r)]; }
+};
+
+/// @brief Maps every pixel to an entry of `_palette`
+/// @param _dither Floyd-Steinberg error diffusion, rows alternate direction. Dithering carries the error from
+/// row to row so it runs on one thread, plain mapping runs in parallel
+template <class Format>
+palette_image remap(const image_view<Format> &_img, const std::vector<RGBQUAD> &_palette, bool _dither = true)
+{
+    static_assert(!Format::is_gray && sizeof(typename Format::channel) == 1, "remapping needs 8 bit colour channels");
+    palette_image _out{image_gray8(_img.width(), _img.height()), _palette};
+    if (_palette.empty() || _img.empty())
+        return _out;
+    inverse_colour_map _map(_palette);
+    const size_t _w = _img.width();
+
+    if (!_dither)
+    {
+        parallel_for(_img.height(), [&](size_t _begin, size_t _end)
+                     {
+            for (size_t _y = _begin; _y < _end; _y++)
+            {
+                const BYTE *_px = _img.channels(_y);
+                BYTE *_idx = _out.indices.row(_y);
+                for (size_t _x = 0; _x < _w; _x++, _px += Format::channels)
+                    _idx[_x] = _map(_px[Format::blue], _px[Format::green], _px[Format::red]);
+            } }, 16);
+        return _out;
+    }
+
+    // errors in 1/16ths of a level, one pixel of margin on both sides, three channels each
+    tracked_vector<int> _this_row((_w + 2) * 3), _next_row((_w + 2) * 3);
+    const size_t _offsets[3] = {Format::blue, Format::green, Format::red};
+    for (size_t _y = 0; _y < _img.height(); _y++)
+    {
+        std::fill(_next_row.begin(), _next_row.end(), 0);
+        const BYTE *_px = _img.channels(_y);
+        BYTE *_idx = _out.indices.row(_y);
+        bool _forward = _y % 2 == 0;
+        ptrdiff_t _step = _forward ? 1 : -1;
+        for (size_t _i = 0; _i < _w; _i++)
+        {
+            size_t _x = _forward ? _i : _w - 1 - _i;
+            int _value[3];
+            for (size_t _c = 0; _c < 3; _c++)
+                _value[_c] = std::clamp(_px[_x * Format::channels + _offsets[_c]] + ((_this_row[(_x + 1) * 3 + _c] + 8) >> 4), 0, 255);
+            BYTE _index = _map(_value[0], _value[1], _value[2]);
+            _idx[_x] = _index;
+            const BYTE _chosen[3] = {_palette[_index].rgbBlue, _palette[_index].rgbGreen, _palette[_index].rgbRed};
+            for (size_t _c = 0; _c < 3; _c++)
+            {
+                int _error = _value[_c] - _chosen[_c];
+                size_t _ahead = (_x + 1 + _step) * 3 + _c, _behind = (_x + 1 - _step) * 3 + _c, _below = (_x + 1) * 3 + _c;
+                _this_row[_ahead] += _error * 7;
+                _next_row[_behind] += _error * 3;
+                _next_row[_below] += _error * 5;
+                _next_row[_ahead] += _error * 1;
+            }
+        }
+        std::swap(_this_row, _next_row);
+    }
+    return _out;
+}
+
+/// @brief Reduces the image to at most `_colours` colours, 16 for a 4 bit bitmap or 256 for an 8 bit one
+template <class Format>
+palette_image quantize(const image_view<Format> &_img, size_t _colours = 256, bool _dither = true)
+{
+    return remap(_img, median_cut_palette(_img, _colours), _dither);
+}
+#pragma endregion
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef RESIZE_HPP
+#define RESIZE_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+#include <cmath>
+#include <type_traits>
+
+#pragma region resize
+enum class resize_filter
+{
+    area,     // exact pixel overlap, the right choice for shrinking
+    bilinear, // triangle, support 1
+    bicubic   // keys cubic with a = -0.5, support 2
+};
+
+/// @brief Filter taps for every output pixel of a (source size, destination size) pair, computed once and
+/// reused for every image of that geometry. Rows are resampled horizontally then vertically in 14 bit fixed point
+class resize_plan
+{
+public:
+    static constexpr int weight_bits = 14;
+
+private:
+    /// @brief taps along one axis, output i reads source [first[i], first[i] + count[i])
+    struct axis_taps
+    {
+        std::vector<int> first;
+        std::vector<int> count;
+        std::vector<int16_t> weights; // max_taps per output, unused slots are 0
+        size_t max_taps{};
+    };
+
+    size_t m_src_width, m_src_height, m_dst_width, m_dst_height;
+    axis_taps m_x, m_y;
+
+    static double kernel(resize_filter _filter, double _x)
+    {
+        _x = std::fabs(_x);
+        if (_filter == resize_filter::bilinear)
+            return _x < 1.0 ? 1.0 - _x : 0.0;
+        // bicubic
+        constexpr double _a = -0.5;
+        if (_x < 1.0)
+            return ((_a + 2.0) * _x - (_a + 3.0)) * _x * _x + 1.0;
+        if (_x < 2.0)
+            return (((_x - 5.0) * _x + 8.0) * _x - 4.0) * _a;
+        return 0.0;
+    }
+
+    static axis_taps make_taps(size_t _src, size_t _dst, resize_filter _filter)
+    {
+        axis_taps _taps;
+        double _scale = static_cast<double>(_src) / _dst;
+        // shrinking stretches the kernel over the source so every source pixel contributes
+        double _stretch = std::max(_scale, 1.0);
+        double _support = (_filter == resize_filter::area ? 0.5 * _scale : (_filter == resize_filter::bilinear ? 1.0 : 2.0) * _stretch);
+        _taps.max_taps = static_cast<size_t>(std::ceil(_support)) * 2 + 2;
+        _taps.first.resize(_dst);
+        _taps.count.resize(_dst);
+        _taps.weights.assign(_dst * _taps.max_taps, 0);
+
+        std::vector<double> _w(_taps.max_taps);
+        for (size_t _i = 0; _i < _dst; _i++)
+        {
+            double _center = (_i + 0.5) * _scale;
+            int _lo = std::max(0, static_cast<int>(std::floor(_center - _support)));
+            int _hi = std::min(static_cast<int>(_src), static_cast<int>(std::ceil(_center + _support)));
+            _hi = std::min(_hi, _lo + static_cast<int>(_taps.max_taps));
+
+            double _sum = 0.0;
+            for (int _j = _lo; _j < _hi; _j++)
+            {
+                double _v;
+                if (_filter == resize_filter::area)
+                {
+                    // overlap of source pixel [j, j + 1) with the output footprint
+                    double _from = _i * _scale, _to = (_i + 1) * _scale;
+                    _v = std::max(0.0, std::min<double>(_j + 1, _to) - std::max<double>(_j, _from));
+                }
+                else
+                {
+                    _v = kernel(_filter, (_j + 0.5 - _center) / _stretch);
+                }
+                _w[_j - _lo] = _v;
+                _sum += _v;
+            }
+            if (_sum == 0.0)
+            {
+                // can only happen when the footprint falls between pixel centres, take the nearest one
+                _lo = std::min(static_cast<int>(_center), static_cast<int>(_src) - 1);
+                _hi = _lo + 1;
+                _w[0] = _sum = 1.0;
+            }
+
+            // quantize, then push the rounding error onto the largest tap so the weights sum to exactly one
+            int16_t *_out = &_taps.weights[_i * _taps.max_taps];
+            int _total = 0, _largest = 0;
+            for (int _k = 0; _k < _hi - _lo; _k++)
+            {
+                _out[_k] = static_cast<int16_t>(std::lround(_w[_k] / _sum * (1 << weight_bits)));
+                _total += _out[_k];
+                if (_out[_k] > _out[_largest])
+                    _largest = _k;
+            }
+            _out[_largest] += static_cast<int16_t>((1 << weight_bits) - _total);
+            _taps.first[_i] = _lo;
+            _taps.count[_i] = _hi - _lo;
+        }
+        return _taps;
+    }
+
+    template <class Channel, class Acc>
+    static Channel clamp_round(Acc _acc)
+    {
+        constexpr Acc _max = std::numeric_limits<Channel>::max();
+        _acc = (_acc + (Acc(1) << (weight_bits - 1))) >> weight_bits;
+        return static_cast<Channel>(_acc < 0 ? 0 : (_acc > _max ? _max : _acc));
+    }
+
+public:
+    resize_plan(size_t src_width, size_t src_height, size_t dst_width, size_t dst_height, resize_filter filter = resize_filter::bilinear)
+        : m_src_width(src_width), m_src_height(src_height), m_dst_width(dst_width), m_dst_height(dst_height)
+    {
+        if (src_width && src_height && dst_width && dst_height)
+        {
+            m_x = make_taps(src_width, dst_width, filter);
+            m_y = make_taps(src_height, dst_height, filter);
+        }
+    }
+
+    size_t src_width() const { return m_src_width; }
+    size_t src_height() const { return m_src_height; }
+    size_t dst_width() const { return m_dst_width; }
+    size_t dst_height() const { return m_dst_height; }
+
+    /// @brief Resamples `_src` into `_dst`, both must have the sizes the plan was made for
+    /// output rows are split into bands, each band resamples horizontally only the source rows it needs
+    template <class Format>
+    bool run(const image_view<Format> &_src, const image_view<Format> &_dst) const
+    {
+        using channel = typename Format::channel;
+        // 16 bit channels times 14 bit weights don't fit an int32 sum
+        using acc_t = std::conditional_t<sizeof(channel) == 1, int32_t, int64_t>;
+        constexpr size_t _c = Format::channels;
+
+        if (_src.width() != m_src_width || _src.height() != m_src_height || _dst.width() != m_dst_width || _dst.height() != m_dst_height)
+        {
+            std::cerr << "Image doesn't match the resize plan" << std::endl;
+            return false;
+        }
+        if (_dst.empty() || _src.empty())
+            return true;
+
+        size_t _dst_row = m_dst_width * _c;
+        parallel_for(m_dst_height, [&](size_t _begin, size_t _end)
+                     {
+            // source rows this band reads
+            int _first_row = m_y.first[_begin];
+            int _last_row = 0;
+            for (size_t _y = _begin; _y < _end; _y++)
+                _last_row = std::max(_last_row, m_y.first[_y] + m_y.count[_y]);
+
+            // horizontal pass into a band local buffer
+            tracked_vector<channel> _band((_last_row - _first_row) * _dst_row);
+            for (int _sy = _first_row; _sy < _last_row; _sy++)
+            {
+                const channel *_in = _src.channels(_sy);
+                channel *_out = &_band[(_sy - _first_row) * _dst_row];
+                for (size_t _x = 0; _x < m_dst_width; _x++)
+                {
+                    const int16_t *_w = &m_x.weights[_x * m_x.max_taps];
+                    const channel *_px = _in + m_x.first[_x] * _c;
+                    acc_t _acc[_c] = {};
+                    for (int _k = 0; _k < m_x.count[_x]; _k++, _px += _c)
+                    {
+                        for (size_t _ch = 0; _ch < _c; _ch++)
+                            _acc[_ch] += acc_t(_w[_k]) * _px[_ch];
+                    }
+                    for (size_t _ch = 0; _ch < _c; _ch++)
+                        _out[_x * _c + _ch] = clamp_round<channel>(_acc[_ch]);
+                }
+            }
+
+            // vertical pass, whole rows at a time so the multiply add runs over contiguous memory
+            tracked_vector<acc_t> _acc(_dst_row);
+            for (size_t _y = _begin; _y < _end; _y++)
+            {
+                std::fill(_acc.begin(), _acc.end(), 0);
+                const int16_t *_w = &m_y.weights[_y * m_y.max_taps];
+                for (int _k = 0; _k < m_y.count[_y]; _k++)
+                {
+                    const channel *_in = &_band[(m_y.first[_y] + _k - _first_row) * _dst_row];
+                    acc_t _wk = _w[_k];
+                    for (size_t _i = 0; _i < _dst_row; _i++)
+                        _acc[_i] += _wk * _in[_i];
+                }
+                channel *_out = _dst.channels(_y);
+                for (size_t _i = 0; _i < _dst_row; _i++)
+                    _out[_i] = clamp_round<channel>(_acc[_i]);
+            } }, 16);
+        return true;
+    }
+};
+
+/// @brief Resizes a view into a new image, build a resize_plan directly to reuse the taps across images
+template <class Format>
+image<Format> resize(const image_view<Format> &_src, size_t _width, size_t _height, resize_filter _filter = resize_filter::bilinear)
+{
+    image<Format> _dst(_width, _height);
+    resize_plan(_src.width(), _src.height(), _width, _height, _filter).run(_src, _dst.view());
+    return _dst;
+}
+#pragma endregion
+
+#endif
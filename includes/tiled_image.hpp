@@ -0,0 +1,208 @@
+#ifndef TILED_IMAGE_HPP
+#define TILED_IMAGE_HPP
+
+#include "utilities.hpp"
+#include "lossless_codec.hpp"
+#include <atomic>
+
+#pragma region container
+#pragma pack(push, 1) // Disable padding
+// Layout: header, tiles_x * tiles_y + 1 QWORD offsets from the start of the file, then the tiles in
+// row major order, tile i occupying [offset i, offset i+1). Every tile is a self contained lossless container
+typedef struct tagTILEDHEADER
+{
+    DWORD thMagic; // TBMP
+    DWORD thWidth;
+    DWORD thHeight;
+    DWORD thTileWidth;
+    DWORD thTileHeight;
+} TILEDHEADER;
+#pragma pack(pop) // enable padding
+#pragma endregion
+
+#pragma region tiled_image
+/// @brief Reads rectangles out of a tiled container, decoding only the tiles they touch
+/// row and column indices follow rgb_data, i.e. row 0 is the top row as get_pixel_data returns it
+class tiled_image
+{
+private:
+    std::string m_file_name;
+    TILEDHEADER m_th{};
+    size_t m_tiles_x{}, m_tiles_y{};
+    std::vector<uint64_t> m_offsets;
+
+public:
+    static constexpr DWORD magic = 0x504d4254; // TBMP in little endian
+
+    tiled_image(std::string file_name) : m_file_name(file_name) {}
+
+    /// @brief Writes the pixels as independently coded tiles, tiles are compressed in parallel
+    /// @param _tile_size width and height of a tile, edge tiles are cropped to the image
+    static bool write_file(const std::string &_file_name, const rgb_data &_dat, size_t _tile_size = 256, bool _planar = true)
+    {
+        std::ofstream _out_file(_file_name, std::ios_base::binary);
+        if (!_out_file.is_open())
+        {
+            std::cerr << "Can't open the output file!";
+            return false;
+        }
+        _tile_size = std::max<size_t>(_tile_size, 1);
+
+        TILEDHEADER _th{};
+        _th.thMagic = magic;
+        _th.thHeight = static_cast<DWORD>(_dat.size());
+        _th.thWidth = static_cast<DWORD>(_dat.empty() ? 0 : _dat[0].size());
+        _th.thTileWidth = static_cast<DWORD>(_tile_size);
+        _th.thTileHeight = static_cast<DWORD>(_tile_size);
+        size_t _tiles_x = (_th.thWidth + _tile_size - 1) / _tile_size;
+        size_t _tiles_y = (_th.thHeight + _tile_size - 1) / _tile_size;
+
+        std::vector<tracked_vector<char>> _tiles(_tiles_x * _tiles_y);
+        parallel_for(_tiles.size(), [&](size_t _begin, size_t _end)
+                     {
+            for (size_t _t = _begin; _t < _end; _t++)
+            {
+                size_t _x0 = (_t % _tiles_x) * _tile_size;
+                size_t _y0 = (_t / _tiles_x) * _tile_size;
+                size_t _w = std::min<size_t>(_tile_size, _th.thWidth - _x0);
+                size_t _h = std::min<size_t>(_tile_size, _th.thHeight - _y0);
+                lossless::compress_rows(_w, _h, [&](size_t _row)
+                                        { return &_dat[_y0 + _row][_x0]; }, _tiles[_t], _planar);
+            } });
+
+        std::vector<uint64_t> _offsets(_tiles.size() + 1);
+        _offsets[0] = sizeof(TILEDHEADER) + _offsets.size() * sizeof(uint64_t);
+        for (size_t _t = 0; _t < _tiles.size(); _t++)
+            _offsets[_t + 1] = _offsets[_t] + _tiles[_t].size();
+
+        _out_file.write(reinterpret_cast<char *>(&_th), sizeof(TILEDHEADER));
+        _out_file.write(reinterpret_cast<char *>(_offsets.data()), _offsets.size() * sizeof(uint64_t));
+        for (auto &_tile : _tiles)
+            _out_file.write(_tile.data(), _tile.size());
+        return _out_file.good();
+    }
+
+    /// @brief Reads the header and the tile index, no pixel data is touched
+    /// @return false if the index doesn't describe tiles laid back to back inside the file
+    bool open()
+    {
+        std::ifstream _in_file(m_file_name, std::ios_base::binary);
+        if (!_in_file.is_open())
+        {
+            std::cerr << "No such file exists";
+            return false;
+        }
+        if (!_in_file.read(reinterpret_cast<char *>(&m_th), sizeof(TILEDHEADER)) || m_th.thMagic != magic ||
+            m_th.thTileWidth == 0 || m_th.thTileHeight == 0)
+        {
+            std::cerr << "Not a tiled container!";
+            return false;
+        }
+        std::error_code _ec;
+        uint64_t _file_size = std::filesystem::file_size(m_file_name, _ec);
+        if (_ec)
+        {
+            std::cerr << "Can't get the size of " << m_file_name << ": " << _ec.message() << std::endl;
+            return false;
+        }
+        m_tiles_x = (m_th.thWidth + m_th.thTileWidth - 1) / m_th.thTileWidth;
+        m_tiles_y = (m_th.thHeight + m_th.thTileHeight - 1) / m_th.thTileHeight;
+        // every tile takes an index entry and at least a container header, so the file bounds the tile count
+        // before the index is allocated
+        size_t _tiles = m_tiles_x * m_tiles_y;
+        if (_tiles > (_file_size - sizeof(TILEDHEADER)) / (sizeof(uint64_t) + sizeof(LOSSLESSHEADER)))
+        {
+            std::cerr << "Tile index larger than the file!";
+            return false;
+        }
+        m_offsets.resize(_tiles + 1);
+        if (!_in_file.read(reinterpret_cast<char *>(m_offsets.data()), m_offsets.size() * sizeof(uint64_t)))
+        {
+            std::cerr << "Truncated tile index!";
+            m_offsets.clear();
+            return false;
+        }
+        // tiles follow the index back to back and end inside the file, so no tile read can go past it
+        bool _valid = m_offsets[0] == sizeof(TILEDHEADER) + m_offsets.size() * sizeof(uint64_t) && m_offsets.back() <= _file_size;
+        for (size_t _t = 0; _valid && _t < _tiles; _t++)
+            _valid = m_offsets[_t + 1] >= m_offsets[_t];
+        if (!_valid)
+        {
+            std::cerr << "Corrupt tile index!";
+            m_offsets.clear();
+            return false;
+        }
+        return true;
+    }
+
+    /// @brief Decodes the rectangle at (_x, _y) of size _w x _h into `_out`, which is resized to fit
+    /// only the intersecting tiles are read and they are decoded in parallel
+    /// @return false if the rectangle leaves the image or a tile is corrupt
+    bool read_region(size_t _x, size_t _y, size_t _w, size_t _h, rgb_data &_out)
+    {
+        if (m_offsets.empty())
+        {
+            std::cerr << "Tiled container not open!";
+            return false;
+        }
+        if (_x + _w > m_th.thWidth || _y + _h > m_th.thHeight)
+        {
+            std::cerr << "Region outside of the image!";
+            return false;
+        }
+        _out.assign(_h, std::vector<RGBTRIPLE>(_w));
+        if (_w == 0 || _h == 0)
+            return true;
+
+        size_t _tw = m_th.thTileWidth, _th = m_th.thTileHeight;
+        std::vector<size_t> _touched;
+        for (size_t _ty = _y / _th; _ty <= (_y + _h - 1) / _th; _ty++)
+        {
+            for (size_t _tx = _x / _tw; _tx <= (_x + _w - 1) / _tw; _tx++)
+                _touched.push_back(_ty * m_tiles_x + _tx);
+        }
+
+        std::atomic<bool> _ok{true};
+        parallel_for(_touched.size(), [&](size_t _begin, size_t _end)
+                     {
+            // one stream and scratch buffer per worker
+            std::ifstream _in_file(m_file_name, std::ios_base::binary);
+            tracked_vector<char> _packed;
+            tracked_vector<BYTE> _pixels;
+            for (size_t _i = _begin; _i < _end && _ok; _i++)
+            {
+                size_t _t = _touched[_i];
+                size_t _x0 = (_t % m_tiles_x) * _tw, _y0 = (_t / m_tiles_x) * _th;
+                size_t _tile_w{}, _tile_h{};
+                _packed.resize(m_offsets[_t + 1] - m_offsets[_t]);
+                _in_file.seekg(m_offsets[_t]);
+                if (!_in_file.read(_packed.data(), _packed.size()) ||
+                    !lossless::decode_pixels(_packed.data(), _packed.size(), _tile_w, _tile_h, _pixels) ||
+                    _tile_w != std::min(_tw, width() - _x0) || _tile_h != std::min(_th, height() - _y0))
+                {
+                    _ok = false;
+                    break;
+                }
+
+                // copy the part of the tile inside the rectangle
+                size_t _from_x = std::max(_x, _x0), _to_x = std::min(_x + _w, _x0 + _tile_w);
+                size_t _from_y = std::max(_y, _y0), _to_y = std::min(_y + _h, _y0 + _tile_h);
+                for (size_t _row = _from_y; _row < _to_y; _row++)
+                {
+                    const BYTE *_src = &_pixels[((_row - _y0) * _tile_w + (_from_x - _x0)) * sizeof(RGBTRIPLE)];
+                    std::memcpy(&_out[_row - _y][_from_x - _x], _src, (_to_x - _from_x) * sizeof(RGBTRIPLE));
+                }
+            } });
+
+        if (!_ok)
+            std::cerr << "Corrupt tile in " << m_file_name << std::endl;
+        return _ok;
+    }
+
+    size_t width() const { return m_th.thWidth; }
+    size_t height() const { return m_th.thHeight; }
+    size_t tile_count() const { return m_tiles_x * m_tiles_y; }
+};
+#pragma endregion
+
+#endif
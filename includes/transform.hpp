@@ -0,0 +1,108 @@
+#ifndef TRANSFORM_HPP
+#define TRANSFORM_HPP
+
+#include "utilities.hpp"
+#include "image.hpp"
+
+#pragma region transform
+enum class rotation
+{
+    cw90,
+    cw180,
+    cw270 // same as 90 counter clockwise
+};
+
+/// @brief `_dst`(x, y) = `_src`(y, x), `_dst` must be src.height() x src.width() and must not overlap `_src`
+/// pixels move in square blocks small enough that the block of source rows and the block of destination rows
+/// both stay in L1, bands of blocks run in parallel. Negative strides on either side give the rotations
+template <class Format>
+void transpose(const image_view<Format> &_src, const image_view<Format> &_dst)
+{
+    using pixel = typename Format::pixel;
+    constexpr size_t _block = sizeof(pixel) == 1 ? 64 : 32;
+    if (_dst.width() != _src.height() || _dst.height() != _src.width())
+    {
+        std::cerr << "Transpose destination has the wrong size" << std::endl;
+        return;
+    }
+    const size_t _bands = (_dst.height() + _block - 1) / _block;
+    parallel_for(_bands, [&](size_t _begin, size_t _end)
+                 {
+        for (size_t _band = _begin; _band < _end; _band++)
+        {
+            size_t _y0 = _band * _block, _y1 = std::min(_y0 + _block, _dst.height());
+            for (size_t _x0 = 0; _x0 < _dst.width(); _x0 += _block)
+            {
+                size_t _x1 = std::min(_x0 + _block, _dst.width());
+                for (size_t _y = _y0; _y < _y1; _y++)
+                {
+                    pixel *_out = _dst.row(_y);
+                    for (size_t _x = _x0; _x < _x1; _x++)
+                        _out[_x] = _src.row(_x)[_y];
+                }
+            }
+        } }, 1);
+}
+
+/// @brief Mirrors every row left to right, `_src` and `_dst` may be the same view
+template <class Format>
+void flip_horizontal(const image_view<Format> &_src, const image_view<Format> &_dst)
+{
+    using pixel = typename Format::pixel;
+    const bool _in_place = _src.data() == _dst.data() && _src.stride() == _dst.stride();
+    parallel_for(_src.height(), [&](size_t _begin, size_t _end)
+                 {
+        for (size_t _y = _begin; _y < _end; _y++)
+        {
+            pixel *_in = _src.row(_y), *_out = _dst.row(_y);
+            if (_in_place)
+                std::reverse(_out, _out + _src.width());
+            else
+                std::reverse_copy(_in, _in + _src.width(), _out);
+        } }, 32);
+}
+
+/// @brief Copies the rows upside down into a `_dst` that doesn't overlap `_src`
+/// image_view::flipped_rows gives the same result without copying
+template <class Format>
+void flip_vertical(const image_view<Format> &_src, const image_view<Format> &_dst)
+{
+    image_view<Format> _flipped = _src.flipped_rows();
+    parallel_for(_src.height(), [&](size_t _begin, size_t _end)
+                 {
+        for (size_t _y = _begin; _y < _end; _y++)
+            std::memcpy(_dst.row(_y), _flipped.row(_y), _src.row_bytes()); }, 32);
+}
+
+/// @brief Rotates `_src` into `_dst`, which must be sized for the result and must not overlap `_src`
+/// the quarter turns are a transpose with one side read upside down, the half turn a mirrored copy of the rows
+/// read upside down
+template <class Format>
+void rotate(const image_view<Format> &_src, const image_view<Format> &_dst, rotation _rotation)
+{
+    switch (_rotation)
+    {
+    case rotation::cw90:
+        transpose(_src.flipped_rows(), _dst);
+        break;
+    case rotation::cw180:
+        flip_horizontal(_src.flipped_rows(), _dst);
+        break;
+    case rotation::cw270:
+        transpose(_src, _dst.flipped_rows());
+        break;
+    }
+}
+
+/// @brief Rotates a view into a new image
+template <class Format>
+image<Format> rotated(const image_view<Format> &_src, rotation _rotation)
+{
+    bool _quarter = _rotation != rotation::cw180;
+    image<Format> _dst(_quarter ? _src.height() : _src.width(), _quarter ? _src.width() : _src.height());
+    rotate(_src, _dst.view(), _rotation);
+    return _dst;
+}
+#pragma endregion
+
+#endif
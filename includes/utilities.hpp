@@ -12,6 +12,13 @@
 #include <unordered_map>
 #include <bitset>
 #include <map>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "memory_tracking.hpp"
 
 typedef uint8_t BYTE;  // 1
 typedef uint16_t WORD; // 2
@@ -25,7 +32,503 @@ typedef struct tagRGBTRIPLE
     BYTE rgbtGreen;
     BYTE rgbtRed;
 } RGBTRIPLE, *PRGBTRIPLE, *NPRGBTRIPLE, *LPRGBTRIPLE;
-#pragma pop(0) // enable padding
+#pragma pack(pop) // enable padding
+
+#pragma pack(push, 1) // Disable padding
+typedef struct tagRGBQUAD
+{
+    BYTE rgbBlue;
+    BYTE rgbGreen;
+    BYTE rgbRed;
+    BYTE rgbReserved;
+} RGBQUAD;
+#pragma pack(pop) // enable padding
+
+using rgb_data = std::vector<std::vector<RGBTRIPLE>>;
+
+/// @brief true on threads that already are one of many workers, parallel_for runs inline on them
+/// so a pool of workers each running a filter doesn't start threads * threads threads
+bool &parallel_for_inline()
+{
+    thread_local bool _inline = false;
+    return _inline;
+}
+
+/// @brief Splits [0, _count) into one contiguous chunk per hardware thread and calls `_fn(begin, end)` on each
+/// an exception thrown by a chunk is rethrown after every chunk has finished, later ones are dropped
+/// @param _min_chunk smallest chunk worth a thread of its own
+template <class Fn>
+void parallel_for(size_t _count, Fn &&_fn, size_t _min_chunk = 1)
+{
+    size_t _threads = parallel_for_inline() ? 1 : std::max<size_t>(1, std::thread::hardware_concurrency());
+    _threads = std::min(_threads, (_count + _min_chunk - 1) / std::max<size_t>(_min_chunk, 1));
+    if (_threads <= 1)
+    {
+        if (_count)
+            _fn(size_t(0), _count);
+        return;
+    }
+    size_t _chunk = (_count + _threads - 1) / _threads;
+    std::vector<std::thread> _workers;
+    memory_detail::scope_state *_scope = memory_detail::current_state();
+    // first exception of any chunk, rethrown once every worker has been joined
+    std::exception_ptr _error;
+    std::mutex _error_lock;
+    auto _run = [&](size_t _begin, size_t _end)
+    {
+        try
+        {
+            _fn(_begin, _end);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> _lock(_error_lock);
+            if (!_error)
+                _error = std::current_exception();
+        }
+    };
+    try
+    {
+        for (size_t _begin = _chunk; _begin < _count; _begin += _chunk)
+            _workers.emplace_back([&_run, _begin, _chunk, _count, _scope]
+                                  {
+                memory_scope_binding _binding(_scope);
+                _run(_begin, std::min(_begin + _chunk, _count)); });
+    }
+    catch (...)
+    {
+        for (auto &_worker : _workers)
+            _worker.join();
+        throw;
+    }
+    _run(size_t(0), std::min(_chunk, _count));
+    for (auto &_worker : _workers)
+        _worker.join();
+    if (_error)
+        std::rethrow_exception(_error);
+}
+
+/// @brief Bounded lock free queue for any number of producers and consumers
+/// every cell carries a sequence number telling whether it is ready to be written or read in the current lap,
+/// so a push or pop is one compare and swap on the shared position and no thread ever waits on a lock
+template <class T>
+class bounded_queue
+{
+private:
+    struct cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+    std::unique_ptr<cell[]> m_cells;
+    size_t m_mask;
+    alignas(64) std::atomic<size_t> m_push_pos{0};
+    alignas(64) std::atomic<size_t> m_pop_pos{0};
+
+public:
+    /// @param capacity rounded up to a power of two
+    explicit bounded_queue(size_t capacity)
+    {
+        size_t _size = 2;
+        while (_size < capacity)
+            _size <<= 1;
+        m_cells.reset(new cell[_size]);
+        m_mask = _size - 1;
+        for (size_t _i = 0; _i < _size; _i++)
+            m_cells[_i].sequence.store(_i, std::memory_order_relaxed);
+    }
+
+    /// @return false when the queue is full
+    bool try_push(T _value)
+    {
+        size_t _pos = m_push_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell &_cell = m_cells[_pos & m_mask];
+            size_t _seq = _cell.sequence.load(std::memory_order_acquire);
+            ptrdiff_t _diff = static_cast<ptrdiff_t>(_seq) - static_cast<ptrdiff_t>(_pos);
+            if (_diff == 0)
+            {
+                if (m_push_pos.compare_exchange_weak(_pos, _pos + 1, std::memory_order_relaxed))
+                {
+                    _cell.value = std::move(_value);
+                    _cell.sequence.store(_pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (_diff < 0)
+                return false;
+            else
+                _pos = m_push_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    /// @return false when the queue is empty
+    bool try_pop(T &_value)
+    {
+        size_t _pos = m_pop_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell &_cell = m_cells[_pos & m_mask];
+            size_t _seq = _cell.sequence.load(std::memory_order_acquire);
+            ptrdiff_t _diff = static_cast<ptrdiff_t>(_seq) - static_cast<ptrdiff_t>(_pos + 1);
+            if (_diff == 0)
+            {
+                if (m_pop_pos.compare_exchange_weak(_pos, _pos + 1, std::memory_order_relaxed))
+                {
+                    _value = std::move(_cell.value);
+                    _cell.sequence.store(_pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (_diff < 0)
+                return false;
+            else
+                _pos = m_pop_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+};
+
+/// @brief bounded_queue whose callers can block while it is empty or full instead of spinning
+/// pushes and pops stay lock free, the lock is only taken by a thread about to sleep and, while any thread
+/// sleeps, by the push or pop that wakes it
+template <class T>
+class blocking_queue
+{
+private:
+    bounded_queue<T> m_queue;
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+    std::atomic<size_t> m_sleeping{0};
+
+    /// @brief blocks until `_ready()`, which runs under the lock and again after every notify
+    template <class Pred>
+    void wait(Pred &&_ready)
+    {
+        std::unique_lock<std::mutex> _lock(m_lock);
+        m_sleeping.fetch_add(1, std::memory_order_relaxed);
+        // pairs with the fence in notify: either the waker sees a sleeper or `_ready` sees the waker's change
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_changed.wait(_lock, _ready);
+        m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+public:
+    explicit blocking_queue(size_t capacity) : m_queue(capacity) {}
+
+    /// @brief wakes the sleeping threads so they check the queue and their stop condition again
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_relaxed) == 0)
+            return;
+        {
+            std::lock_guard<std::mutex> _lock(m_lock);
+        }
+        m_changed.notify_all();
+    }
+
+    /// @return false when the queue is full
+    bool try_push(T _value)
+    {
+        if (!m_queue.try_push(std::move(_value)))
+            return false;
+        notify();
+        return true;
+    }
+
+    /// @return false when the queue is empty
+    bool try_pop(T &_value)
+    {
+        if (!m_queue.try_pop(_value))
+            return false;
+        notify();
+        return true;
+    }
+
+    /// @brief waits while the queue is full
+    void push(const T &_value)
+    {
+        if (!m_queue.try_push(_value))
+            wait([&]
+                 { return m_queue.try_push(_value); });
+        notify();
+    }
+
+    /// @brief waits while the queue is empty
+    void pop(T &_value)
+    {
+        pop_unless(_value, []
+                   { return false; });
+    }
+
+    /// @brief waits while the queue is empty and `_stop()` is false, call notify after changing what `_stop` reads
+    /// @return false once the queue is empty and `_stop()` is true, what was pushed before `_stop` turned true is still popped
+    template <class Stop>
+    bool pop_unless(T &_value, Stop &&_stop)
+    {
+        if (!m_queue.try_pop(_value))
+        {
+            bool _stopped = false;
+            wait([&]
+                 { return m_queue.try_pop(_value) || (_stopped = _stop()); });
+            if (_stopped && !m_queue.try_pop(_value))
+                return false;
+        }
+        notify();
+        return true;
+    }
+
+    size_t capacity() const { return m_queue.capacity(); }
+};
+
+/// @brief Reads a stream in fixed size chunks on a background thread, up to `buffers` chunks ahead of the caller
+/// so the next chunk is already coming in while the current one is processed. The stream must not be touched
+/// until the reader is destroyed, after that it stands right behind the last byte read
+class read_ahead_reader
+{
+private:
+    std::istream &m_in;
+    size_t m_chunk_size, m_remaining;
+    std::vector<tracked_vector<char>> m_buffers;
+    std::vector<size_t> m_sizes;
+    size_t m_filled{}; // chunks read and not yet released, the one the caller holds included
+    bool m_end{}, m_stop{};
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+    // caller side
+    size_t m_current{}, m_offset{};
+    bool m_holding{};
+    std::thread m_thread;
+
+    void fill_loop()
+    {
+        for (size_t _slot = 0;; _slot = (_slot + 1) % m_buffers.size())
+        {
+            size_t _want = std::min(m_chunk_size, m_remaining);
+            if (_want != 0)
+            {
+                std::unique_lock<std::mutex> _lock(m_lock);
+                m_changed.wait(_lock, [&]
+                               { return m_stop || m_filled < m_buffers.size(); });
+                if (m_stop)
+                    return;
+            }
+            size_t _got = 0;
+            if (_want != 0)
+            {
+                m_in.read(m_buffers[_slot].data(), _want);
+                _got = static_cast<size_t>(m_in.gcount());
+                m_remaining -= _got;
+            }
+            {
+                std::lock_guard<std::mutex> _lock(m_lock);
+                if (_got != 0)
+                {
+                    m_sizes[_slot] = _got;
+                    m_filled++;
+                }
+                // a short read is the end of the stream, a full one learns it from the read after
+                if (_got < _want || _want == 0)
+                    m_end = true;
+            }
+            m_changed.notify_all();
+            if (_got < _want || _want == 0)
+                return;
+        }
+    }
+
+    /// @brief hands the held chunk back to the thread and waits for the next one
+    /// @return false at the end of the stream
+    bool advance()
+    {
+        std::unique_lock<std::mutex> _lock(m_lock);
+        if (m_holding)
+        {
+            m_filled--;
+            m_current = (m_current + 1) % m_buffers.size();
+            m_holding = false;
+            m_changed.notify_all();
+        }
+        m_changed.wait(_lock, [&]
+                       { return m_filled > 0 || m_end; });
+        if (m_filled == 0)
+            return false;
+        m_holding = true;
+        m_offset = 0;
+        return true;
+    }
+
+public:
+    /// @param chunk_size bytes per read
+    /// @param buffers chunks held at once, the one being processed included, at least 2
+    /// @param limit bytes to read at most, the stream isn't read past them and no chunk is larger
+    read_ahead_reader(std::istream &in, size_t chunk_size, size_t buffers = 3, size_t limit = SIZE_MAX)
+        : m_in(in), m_chunk_size(std::max<size_t>(std::min(chunk_size, limit), 1)), m_remaining(limit),
+          m_buffers(std::max<size_t>(buffers, 2), tracked_vector<char>(m_chunk_size)), m_sizes(m_buffers.size())
+    {
+        m_thread = std::thread([this]
+                               { fill_loop(); });
+    }
+
+    read_ahead_reader(const read_ahead_reader &) = delete;
+    read_ahead_reader &operator=(const read_ahead_reader &) = delete;
+
+    ~read_ahead_reader()
+    {
+        {
+            std::lock_guard<std::mutex> _lock(m_lock);
+            m_stop = true;
+        }
+        m_changed.notify_all();
+        m_thread.join();
+    }
+
+    /// @brief the rest of the current chunk, or the next chunk once it is used up
+    /// @param _data points into the reader's buffer until the next call
+    /// @return bytes at `_data`, 0 at the end of the stream
+    size_t next(const char *&_data)
+    {
+        if ((!m_holding || m_offset == m_sizes[m_current]) && !advance())
+            return 0;
+        _data = m_buffers[m_current].data() + m_offset;
+        size_t _size = m_sizes[m_current] - m_offset;
+        m_offset = m_sizes[m_current];
+        return _size;
+    }
+
+    /// @brief copies the next `_size` bytes to `_dst` whatever chunks they span
+    /// @return bytes copied, less than `_size` only at the end of the stream
+    size_t read(char *_dst, size_t _size)
+    {
+        size_t _copied = 0;
+        while (_copied < _size)
+        {
+            if ((!m_holding || m_offset == m_sizes[m_current]) && !advance())
+                break;
+            size_t _n = std::min(_size - _copied, m_sizes[m_current] - m_offset);
+            std::memcpy(_dst + _copied, m_buffers[m_current].data() + m_offset, _n);
+            m_offset += _n;
+            _copied += _n;
+        }
+        return _copied;
+    }
+
+    /// @brief true when every byte of the stream has been handed out, waits for the read after the current chunk
+    bool at_end()
+    {
+        if (m_holding && m_offset != m_sizes[m_current])
+            return false;
+        std::unique_lock<std::mutex> _lock(m_lock);
+        size_t _held = m_holding ? 1 : 0;
+        m_changed.wait(_lock, [&]
+                       { return m_filled > _held || m_end; });
+        return m_filled == _held;
+    }
+};
+
+/// @brief Collects writes into fixed size chunks that a background thread writes to the stream while the
+/// caller fills the next one. The stream must not be touched until flush returns or the writer is destroyed
+class write_behind_writer
+{
+private:
+    std::ostream &m_out;
+    std::vector<tracked_vector<char>> m_buffers;
+    std::vector<size_t> m_sizes;
+    size_t m_queued{}; // full chunks waiting for the thread
+    bool m_stop{}, m_failed{};
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+    // caller side
+    size_t m_current{}, m_fill{};
+    std::thread m_thread;
+
+    void drain_loop()
+    {
+        for (size_t _slot = 0;; _slot = (_slot + 1) % m_buffers.size())
+        {
+            {
+                std::unique_lock<std::mutex> _lock(m_lock);
+                m_changed.wait(_lock, [&]
+                               { return m_stop || m_queued > 0; });
+                if (m_queued == 0)
+                    return;
+            }
+            bool _good = static_cast<bool>(m_out.write(m_buffers[_slot].data(), m_sizes[_slot]));
+            {
+                std::lock_guard<std::mutex> _lock(m_lock);
+                m_queued--;
+                m_failed |= !_good;
+            }
+            m_changed.notify_all();
+        }
+    }
+
+    /// @brief queues the current chunk and waits until the one after it is free
+    void hand_over()
+    {
+        std::unique_lock<std::mutex> _lock(m_lock);
+        m_sizes[m_current] = m_fill;
+        m_queued++;
+        m_changed.notify_all();
+        m_current = (m_current + 1) % m_buffers.size();
+        m_fill = 0;
+        m_changed.wait(_lock, [&]
+                       { return m_queued < m_buffers.size(); });
+    }
+
+public:
+    /// @param chunk_size bytes per write
+    /// @param buffers chunks held at once, the one being filled included, at least 2
+    write_behind_writer(std::ostream &out, size_t chunk_size, size_t buffers = 3)
+        : m_out(out), m_buffers(std::max<size_t>(buffers, 2), tracked_vector<char>(std::max<size_t>(chunk_size, 1))), m_sizes(m_buffers.size())
+    {
+        m_thread = std::thread([this]
+                               { drain_loop(); });
+    }
+
+    write_behind_writer(const write_behind_writer &) = delete;
+    write_behind_writer &operator=(const write_behind_writer &) = delete;
+
+    ~write_behind_writer()
+    {
+        flush();
+        {
+            std::lock_guard<std::mutex> _lock(m_lock);
+            m_stop = true;
+        }
+        m_changed.notify_all();
+        m_thread.join();
+    }
+
+    void write(const char *_data, size_t _size)
+    {
+        while (_size != 0)
+        {
+            size_t _n = std::min(_size, m_buffers[m_current].size() - m_fill);
+            std::memcpy(m_buffers[m_current].data() + m_fill, _data, _n);
+            m_fill += _n;
+            _data += _n;
+            _size -= _n;
+            if (m_fill == m_buffers[m_current].size())
+                hand_over();
+        }
+    }
+
+    /// @brief waits until everything written so far reached the stream
+    /// @return false if any write to the stream failed
+    bool flush()
+    {
+        if (m_fill != 0)
+            hand_over();
+        std::unique_lock<std::mutex> _lock(m_lock);
+        m_changed.wait(_lock, [&]
+                       { return m_queued == 0; });
+        return !m_failed;
+    }
+};
 
 void displayCharBits(char c)
 {
@@ -35,14 +538,14 @@ void displayCharBits(char c)
 
 class bit_reader
 {
-    char *m_buffer;
+    const char *m_buffer;
     size_t m_bytes;
     size_t m_cur_bit = 7;
     size_t m_cur_byte{};
     size_t m_eof_bits{};
 
 public:
-    bit_reader(char *_buf, size_t _bytes, size_t _eof_bits = 0)
+    bit_reader(const char *_buf, size_t _bytes, size_t _eof_bits = 0)
         : m_buffer(_buf), m_bytes(_bytes), m_eof_bits(_eof_bits) {}
     int get_next_bit()
     {
@@ -79,7 +582,7 @@ public:
         // std::cout<<"read "<<cnt<<" padding bits";
     }
 
-    void re_initialize(char *_buff, size_t _bytes, size_t _eof_bits = 0)
+    void re_initialize(const char *_buff, size_t _bytes, size_t _eof_bits = 0)
     {
         m_bytes = _bytes;
         m_buffer = _buff;
@@ -89,4 +592,85 @@ public:
     }
 };
 
+/// @brief Appends bits MSB first to a byte vector, used by the in memory huffman blocks
+class bit_writer
+{
+    tracked_vector<char> &m_out;
+    uint64_t m_acc{};
+    int m_acc_bits{};
+
+public:
+    bit_writer(tracked_vector<char> &_out) : m_out(_out) {}
+
+    /// @param _bits value whose low `_count` bits are written, most significant first
+    /// @param _count number of bits, at most 57
+    void put_bits(uint64_t _bits, int _count)
+    {
+        m_acc = (m_acc << _count) | _bits;
+        m_acc_bits += _count;
+        while (m_acc_bits >= 8)
+        {
+            m_acc_bits -= 8;
+            m_out.push_back(static_cast<char>(m_acc >> m_acc_bits));
+        }
+    }
+
+    /// @brief pads the last byte with zero bits
+    void flush()
+    {
+        if (m_acc_bits > 0)
+            put_bits(0, 8 - m_acc_bits);
+    }
+};
+
+/// @brief Reads bits MSB first through a 64 bit window so several bits can be peeked at once
+/// reading past the end yields zero bits, check overrun() once done
+class window_bit_reader
+{
+    const BYTE *m_cur;
+    const BYTE *m_end;
+    size_t m_total_bits;
+    size_t m_consumed_bits{};
+    uint64_t m_window{};
+    int m_window_bits{};
+
+public:
+    window_bit_reader(const char *_buf, size_t _bytes)
+        : m_cur(reinterpret_cast<const BYTE *>(_buf)), m_end(m_cur + _bytes), m_total_bits(_bytes * 8) {}
+
+    /// @brief tops the window up to at least 57 valid bits
+    void refill()
+    {
+        while (m_window_bits <= 56)
+        {
+            uint64_t _byte = m_cur < m_end ? *m_cur++ : 0;
+            m_window |= _byte << (56 - m_window_bits);
+            m_window_bits += 8;
+        }
+    }
+
+    /// @param _count 1 to 57 bits, call refill() first
+    uint64_t peek(int _count) const { return m_window >> (64 - _count); }
+
+    void consume(int _count)
+    {
+        m_window <<= _count;
+        m_window_bits -= _count;
+        m_consumed_bits += _count;
+    }
+
+    uint64_t get_bits(int _count)
+    {
+        refill();
+        uint64_t _res = peek(_count);
+        consume(_count);
+        return _res;
+    }
+
+    /// @brief number of whole bytes touched so far
+    size_t bytes_consumed() const { return (m_consumed_bits + 7) / 8; }
+
+    bool overrun() const { return m_consumed_bits > m_total_bits; }
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,164 @@
+// Applies a chain of operations to every 24 bit bitmap of a directory
+// g++ -std=c++20 -O2 -pthread -Iincludes tools/bmp_batch.cpp -o bmp_batch
+
+#include "batch.hpp"
+#include "convolution.hpp"
+#include "histogram.hpp"
+#include "image_utilities.hpp"
+#include "lut.hpp"
+#include "median_filter.hpp"
+#include "transform.hpp"
+
+using bgr = pixel_format::bgr24;
+using operation = std::function<void(image_bgr24 &)>;
+
+void print_usage()
+{
+    std::cout << "usage: bmp_batch <input dir> <output dir> [options] <operation>...\n"
+                 "options:\n"
+                 "  --threads N      worker threads, default one per core\n"
+                 "  --memory MB      decoded images in flight, default 1024\n"
+                 "  --file-memory MB fail files needing more than this at once\n"
+                 "  --recursive      descend into sub directories\n"
+                 "operations, applied in order:\n"
+                 "  invert  sepia  equalize  sharpen  emboss  edges\n"
+                 "  blur:N (odd)  median:R  gamma:G  rotate:90|180|270  flip-h  flip-v\n";
+}
+
+/// @brief replaces the image with the output of `_filter(src, dst)`
+template <class Filter>
+operation into_new_image(Filter _filter)
+{
+    return [=](image_bgr24 &_img)
+    {
+        image_bgr24 _out(_img.width(), _img.height());
+        _filter(_img.view(), _out.view());
+        _img = std::move(_out);
+    };
+}
+
+bool parse_operation(const std::string &_arg, std::vector<operation> &_ops)
+{
+    size_t _colon = _arg.find(':');
+    std::string _name = _arg.substr(0, _colon);
+    std::string _value = _colon == std::string::npos ? "" : _arg.substr(_colon + 1);
+
+    if (_name == "invert")
+        _ops.push_back([](image_bgr24 &_img)
+                       { invert_colours(_img.view()); });
+    else if (_name == "sepia")
+        _ops.push_back([](image_bgr24 &_img)
+                       { rgb_to_sepia(_img.view()); });
+    else if (_name == "equalize")
+        _ops.push_back([](image_bgr24 &_img)
+                       { equalize_histogram(_img.view()); });
+    else if (_name == "sharpen" || _name == "emboss" || _name == "blur")
+    {
+        convolution_kernel _kernel = convolution_kernel::sharpen();
+        if (_name == "emboss")
+            _kernel = convolution_kernel::emboss();
+        else if (_name == "blur")
+        {
+            size_t _size = _value.empty() ? 5 : std::stoul(_value);
+            if (_size % 2 == 0)
+            {
+                std::cerr << "Blur size must be odd" << std::endl;
+                return false;
+            }
+            _kernel = convolution_kernel::gaussian(_size);
+        }
+        _ops.push_back(into_new_image([=](const image_view<bgr> &_src, const image_view<bgr> &_dst)
+                                      { convolve(_src, _dst, _kernel, border_mode::replicate); }));
+    }
+    else if (_name == "edges")
+    {
+        auto _kx = convolution_kernel::from_matrix(edge_Kernels::SobelFredmanKernel._kernelx);
+        auto _ky = convolution_kernel::from_matrix(edge_Kernels::SobelFredmanKernel._kernely);
+        _ops.push_back(into_new_image([=](const image_view<bgr> &_src, const image_view<bgr> &_dst)
+                                      { gradient_magnitude(_src, _dst, _kx, _ky); }));
+    }
+    else if (_name == "median")
+    {
+        size_t _radius = _value.empty() ? 1 : std::stoul(_value);
+        _ops.push_back(into_new_image([=](const image_view<bgr> &_src, const image_view<bgr> &_dst)
+                                      { median_filter(_src, _dst, _radius); }));
+    }
+    else if (_name == "gamma")
+    {
+        lut_plan _plan;
+        _plan.gamma(_value.empty() ? 2.2 : std::stod(_value));
+        _ops.push_back([=](image_bgr24 &_img)
+                       { _plan.apply(_img.view()); });
+    }
+    else if (_name == "rotate")
+    {
+        if (_value != "90" && _value != "180" && _value != "270")
+            return false;
+        rotation _rotation = _value == "90" ? rotation::cw90 : (_value == "180" ? rotation::cw180 : rotation::cw270);
+        _ops.push_back([=](image_bgr24 &_img)
+                       { _img = rotated(_img.view(), _rotation); });
+    }
+    else if (_name == "flip-h")
+        _ops.push_back([](image_bgr24 &_img)
+                       { flip_horizontal(_img.view(), _img.view()); });
+    else if (_name == "flip-v")
+        _ops.push_back(into_new_image([](const image_view<bgr> &_src, const image_view<bgr> &_dst)
+                                      { flip_vertical(_src, _dst); }));
+    else
+        return false;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        print_usage();
+        return 1;
+    }
+    batch_options _options;
+    std::vector<operation> _ops;
+    try
+    {
+        for (int _i = 3; _i < argc; _i++)
+        {
+            std::string _arg = argv[_i];
+            if (_arg == "--threads" && _i + 1 < argc)
+                _options.threads = std::stoul(argv[++_i]);
+            else if (_arg == "--memory" && _i + 1 < argc)
+                _options.memory_limit = std::stoull(argv[++_i]) << 20;
+            else if (_arg == "--file-memory" && _i + 1 < argc)
+                _options.file_memory_limit = std::stoull(argv[++_i]) << 20;
+            else if (_arg == "--recursive")
+                _options.recursive = true;
+            else if (!parse_operation(_arg, _ops))
+            {
+                std::cerr << "Unknown or invalid operation " << _arg << std::endl;
+                print_usage();
+                return 1;
+            }
+        }
+    }
+    catch (const std::exception &)
+    {
+        std::cerr << "Bad numeric argument" << std::endl;
+        return 1;
+    }
+
+    std::vector<batch_result> _results = batch_process<bgr>(argv[1], argv[2], _ops, _options);
+    size_t _written = 0, _peak = 0;
+    for (const batch_result &_result : _results)
+    {
+        _peak = std::max(_peak, _result.memory.peak_bytes);
+        if (_result.written)
+            _written++;
+        else if (!_result.error.empty())
+            std::cerr << _result.input << ": " << _result.error << std::endl;
+        else if (_result.memory.refused)
+            std::cerr << _result.input << ": over the memory limit" << std::endl;
+        else
+            std::cerr << _result.input << ": " << (_result.status == bmp_status::ok ? "write failed" : to_string(_result.status)) << std::endl;
+    }
+    std::cout << _written << " of " << _results.size() << " files written to " << argv[2] << ", largest file peaked at " << (_peak >> 20) << " MB" << std::endl;
+    return _written == _results.size() ? 0 : 2;
+}